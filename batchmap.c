@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "batchmap.h"
+
+#define MAX_PRODUCERS 64
+
+struct BatchProducer {
+    Pair * ring;
+    unsigned mask;
+    atomic_uint head;
+    atomic_uint tail;
+    unsigned taken;
+    atomic_int closed;
+    BatchMap * batch;
+};
+
+struct BatchMap {
+    TreeMap * tree;
+    unsigned buffer_size;
+    int staleness_ms;
+    BatchProducer * producers[MAX_PRODUCERS];
+    atomic_int count;
+    Pair * pending;
+    int capacity;
+    pthread_t applier;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    pthread_rwlock_t lock;
+    unsigned long requested;
+    unsigned long completed;
+    int running;
+};
+
+
+void removeProducer(BatchMap * batch, int i) {
+    BatchProducer * producer = batch->producers[i];
+    int count = atomic_load_explicit(&batch->count, memory_order_relaxed);
+
+    batch->producers[i] = batch->producers[count - 1];
+    atomic_store_explicit(&batch->count, count - 1, memory_order_release);
+    free(producer->ring);
+    free(producer);
+}
+
+
+// los head solo avanzan despues de aplicar el lote, asi un error deja los
+// datos en los buffers para el proximo intento
+int drainBatchMap(BatchMap * batch) {
+    pthread_mutex_lock(&batch->mutex);
+    int count = atomic_load_explicit(&batch->count, memory_order_relaxed);
+
+    if (count * (int)batch->buffer_size > batch->capacity) {
+        Pair * aux = (Pair *)realloc(batch->pending, count * batch->buffer_size * sizeof(Pair));
+        if (aux == NULL) {
+            pthread_mutex_unlock(&batch->mutex);
+            return -1;
+        }
+        batch->pending = aux;
+        batch->capacity = count * batch->buffer_size;
+    }
+
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        BatchProducer * producer = batch->producers[i];
+        unsigned head = atomic_load_explicit(&producer->head, memory_order_relaxed);
+        unsigned tail = atomic_load_explicit(&producer->tail, memory_order_acquire);
+
+        while (head != tail) {
+            batch->pending[n++] = producer->ring[head & producer->mask];
+            head++;
+        }
+        producer->taken = head;
+    }
+    pthread_mutex_unlock(&batch->mutex);
+
+    if (n > 0) {
+        if (!sortBatchTreeMap(batch->tree, batch->pending, n)) return -1;
+        pthread_rwlock_wrlock(&batch->lock);
+        int ok = insertSortedTreeMap(batch->tree, batch->pending, n);
+        pthread_rwlock_unlock(&batch->lock);
+        if (!ok) return -1;
+    }
+
+    pthread_mutex_lock(&batch->mutex);
+    for (int i = count - 1; i >= 0; i--) {
+        BatchProducer * producer = batch->producers[i];
+        atomic_store_explicit(&producer->head, producer->taken, memory_order_release);
+        if (atomic_load_explicit(&producer->closed, memory_order_acquire) &&
+            producer->taken == atomic_load_explicit(&producer->tail, memory_order_acquire)) {
+            removeProducer(batch, i);
+        }
+    }
+    pthread_mutex_unlock(&batch->mutex);
+    return n;
+}
+
+
+void * applyBatchMap(void * arg) {
+    BatchMap * batch = (BatchMap *)arg;
+    int failed = 0;
+
+    pthread_mutex_lock(&batch->mutex);
+    while (batch->running) {
+        if (batch->requested == batch->completed || failed) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += batch->staleness_ms / 1000;
+            until.tv_nsec += (long)(batch->staleness_ms % 1000) * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&batch->wake, &batch->mutex, &until);
+        }
+
+        unsigned long target = batch->requested;
+        pthread_mutex_unlock(&batch->mutex);
+
+        failed = drainBatchMap(batch) < 0;
+
+        pthread_mutex_lock(&batch->mutex);
+        if (!failed) {
+            batch->completed = target;
+            pthread_cond_broadcast(&batch->done);
+        }
+    }
+    pthread_mutex_unlock(&batch->mutex);
+
+    while (drainBatchMap(batch) < 0) sched_yield();
+    return NULL;
+}
+
+
+BatchMap * createBatchMap(TreeMap * tree, int buffer_size, int staleness_ms) {
+    if (tree == NULL) return NULL;
+
+    BatchMap * batch = (BatchMap *)calloc(1, sizeof(BatchMap));
+    if (batch == NULL) return NULL;
+
+    batch->tree = tree;
+    batch->buffer_size = 16;
+    while ((int)batch->buffer_size < buffer_size) batch->buffer_size *= 2;
+    batch->staleness_ms = (staleness_ms > 0) ? staleness_ms : 1;
+    atomic_init(&batch->count, 0);
+    batch->running = 1;
+
+    pthread_mutex_init(&batch->mutex, NULL);
+    pthread_cond_init(&batch->wake, NULL);
+    pthread_cond_init(&batch->done, NULL);
+    pthread_rwlock_init(&batch->lock, NULL);
+
+    if (pthread_create(&batch->applier, NULL, applyBatchMap, batch) != 0) {
+        pthread_rwlock_destroy(&batch->lock);
+        pthread_cond_destroy(&batch->done);
+        pthread_cond_destroy(&batch->wake);
+        pthread_mutex_destroy(&batch->mutex);
+        free(batch);
+        return NULL;
+    }
+
+    return batch;
+}
+
+
+BatchProducer * registerProducer(BatchMap * batch) {
+    if (batch == NULL) return NULL;
+
+    BatchProducer * producer = (BatchProducer *)malloc(sizeof(BatchProducer));
+    if (producer == NULL) return NULL;
+
+    producer->ring = (Pair *)malloc(batch->buffer_size * sizeof(Pair));
+    if (producer->ring == NULL) {
+        free(producer);
+        return NULL;
+    }
+    producer->mask = batch->buffer_size - 1;
+    producer->batch = batch;
+    producer->taken = 0;
+    atomic_init(&producer->head, 0);
+    atomic_init(&producer->tail, 0);
+    atomic_init(&producer->closed, 0);
+
+    pthread_mutex_lock(&batch->mutex);
+    int count = atomic_load_explicit(&batch->count, memory_order_relaxed);
+    if (count == MAX_PRODUCERS) {
+        pthread_mutex_unlock(&batch->mutex);
+        free(producer->ring);
+        free(producer);
+        return NULL;
+    }
+    batch->producers[count] = producer;
+    atomic_store_explicit(&batch->count, count + 1, memory_order_release);
+    pthread_mutex_unlock(&batch->mutex);
+
+    return producer;
+}
+
+
+void unregisterProducer(BatchProducer * producer) {
+    if (producer == NULL) return;
+
+    BatchMap * batch = producer->batch;
+    atomic_store_explicit(&producer->closed, 1, memory_order_release);
+    flushBatchMap(batch);
+}
+
+
+int batchInsert(BatchProducer * producer, void* key, void * value) {
+    if (producer == NULL || atomic_load_explicit(&producer->closed, memory_order_relaxed)) return 0;
+
+    unsigned tail = atomic_load_explicit(&producer->tail, memory_order_relaxed);
+
+    while (tail - atomic_load_explicit(&producer->head, memory_order_acquire) > producer->mask) {
+        pthread_cond_signal(&producer->batch->wake);
+        sched_yield();
+    }
+
+    producer->ring[tail & producer->mask].key = key;
+    producer->ring[tail & producer->mask].value = value;
+    atomic_store_explicit(&producer->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+
+void flushBatchMap(BatchMap * batch) {
+    if (batch == NULL) return;
+
+    pthread_mutex_lock(&batch->mutex);
+    unsigned long target = ++batch->requested;
+    pthread_cond_signal(&batch->wake);
+    while (batch->completed < target) {
+        pthread_cond_wait(&batch->done, &batch->mutex);
+    }
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+
+void readLockBatchMap(BatchMap * batch) {
+    if (batch != NULL) pthread_rwlock_rdlock(&batch->lock);
+}
+
+
+void readUnlockBatchMap(BatchMap * batch) {
+    if (batch != NULL) pthread_rwlock_unlock(&batch->lock);
+}
+
+
+void lockBatchMap(BatchMap * batch) {
+    if (batch != NULL) pthread_rwlock_wrlock(&batch->lock);
+}
+
+
+void unlockBatchMap(BatchMap * batch) {
+    if (batch != NULL) pthread_rwlock_unlock(&batch->lock);
+}
+
+
+void destroyBatchMap(BatchMap * batch) {
+    if (batch == NULL) return;
+
+    pthread_mutex_lock(&batch->mutex);
+    batch->running = 0;
+    pthread_cond_signal(&batch->wake);
+    pthread_mutex_unlock(&batch->mutex);
+    pthread_join(batch->applier, NULL);
+
+    int count = atomic_load(&batch->count);
+    for (int i = 0; i < count; i++) {
+        free(batch->producers[i]->ring);
+        free(batch->producers[i]);
+    }
+    free(batch->pending);
+
+    pthread_rwlock_destroy(&batch->lock);
+    pthread_cond_destroy(&batch->done);
+    pthread_cond_destroy(&batch->wake);
+    pthread_mutex_destroy(&batch->mutex);
+    free(batch);
+}
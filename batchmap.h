@@ -0,0 +1,40 @@
+#ifndef BATCHMAP_h
+#define BATCHMAP_h
+
+#include "treemap.h"
+
+typedef struct BatchMap BatchMap;
+
+typedef struct BatchProducer BatchProducer;
+
+BatchMap * createBatchMap(TreeMap * tree, int buffer_size, int staleness_ms);
+
+BatchProducer * registerProducer(BatchMap * batch);
+
+void unregisterProducer(BatchProducer * producer);
+
+int batchInsert(BatchProducer * producer, void* key, void * value);
+
+void flushBatchMap(BatchMap * batch);
+
+/*
+ * Con readLockBatchMap varios lectores comparten el mapa, asi que solo
+ * pueden usar funciones que no mueven current ni modifican el arbol:
+ * upperBound, countKey, aggregateRange y freezeTreeMap. searchTreeMap,
+ * seekFrom, equalRange, firstTreeMap y nextTreeMap mueven current, y en
+ * modo cache toda lectura puede expulsar datos: para esas llamadas se usa
+ * lockBatchMap, que excluye al aplicador y a los demas lectores. Una copia
+ * de freezeTreeMap se comparte sin candado con searchFrozenTreeMap,
+ * upperBoundFrozen y nextFrozenAfter.
+ */
+void readLockBatchMap(BatchMap * batch);
+
+void readUnlockBatchMap(BatchMap * batch);
+
+void lockBatchMap(BatchMap * batch);
+
+void unlockBatchMap(BatchMap * batch);
+
+void destroyBatchMap(BatchMap * batch);
+
+#endif /* BATCHMAP_h */
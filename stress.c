@@ -0,0 +1,935 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "treemap.c"
+#include "treemap_gen.h"
+
+// uso: ./stress [operaciones] [semilla] [ns por operacion] [claves]
+
+#define FULL_CHECK 1024
+#define BATCH 4096
+
+int universe = 4096;   // las claves van de 0 a universe - 1
+int* pool;
+int* ref;   // arreglo ordenado de referencia
+int ref_size = 0;
+
+char msg[300];
+
+void err_msg(char* msg){
+    printf("   [FAILED] ");
+    printf("%s\n",msg);
+}
+
+void ok_msg(char* msg){
+    printf ("   [OK] ");
+    printf("%s\n",msg);
+}
+
+int fail(char* msg){
+    err_msg(msg);
+    exit(1);
+}
+
+int lower_than_int(void* key1, void* key2){
+    int k1 = *((int*) (key1));
+    int k2 = *((int*) (key2));
+    return k1<k2;
+}
+
+double measure_int(void* key, void* value){
+    return *((int*) value);
+}
+
+double sum(double a, double b){
+    return a + b;
+}
+
+int released = 0;
+
+void release_int(void* key, void* value){
+    if (key != value) fail("eraseRange entrega un par distinto");
+    released++;
+}
+
+// posicion del primer elemento >= key
+int ref_lower(int key){
+    int lo = 0, hi = ref_size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ref[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void ref_insert(int key){
+    int i = ref_lower(key);
+    if (i < ref_size && ref[i] == key) return;
+    memmove(ref + i + 1, ref + i, (ref_size - i) * sizeof(int));
+    ref[i] = key;
+    ref_size++;
+}
+
+void ref_erase(int key){
+    int i = ref_lower(key);
+    if (i == ref_size || ref[i] != key) return;
+    memmove(ref + i, ref + i + 1, (ref_size - i - 1) * sizeof(int));
+    ref_size--;
+}
+
+int key_of(Pair* p){
+    return *((int*) p->key);
+}
+
+int height(TreeNode* x){
+    int h = 0;
+    while (x != NULL) {
+        h++;
+        x = x->parent;
+    }
+    return h;
+}
+
+// parent, size y orden en el camino de x hasta la raiz
+void check_path(TreeMap* tree, TreeNode* x){
+    while (x != NULL) {
+        if (x->parent == NULL && tree->root != x) fail("nodo sin padre distinto de root");
+        if (x->left != NULL && (x->left->parent != x || !lower_than_int(x->left->pair->key, x->pair->key)))
+            fail("hijo izquierdo invalido");
+        if (x->right != NULL && (x->right->parent != x || !lower_than_int(x->pair->key, x->right->pair->key)))
+            fail("hijo derecho invalido");
+        if (x->size != 1 + nodeSize(x->left) + nodeSize(x->right)) fail("size desactualizado");
+        if (x->aggregate != nodeAggregate(tree, x->left) + key_of(x->pair) + nodeAggregate(tree, x->right))
+            fail("aggregate desactualizado");
+        if (x->soonest != sooner(x->expires, sooner(nodeSoonest(x->left), nodeSoonest(x->right))))
+            fail("soonest desactualizado");
+        x = x->parent;
+    }
+}
+
+int check_tree(TreeMap* tree){
+    if (tree->root != NULL && tree->root->parent != NULL) fail("root con padre");
+    if (nodeSize(tree->root) != ref_size) fail("size de root distinto a la referencia");
+
+    int i = 0, max_height = 0;
+    TreeNode* x = minimum(tree->root);
+    while (x != NULL) {
+        if (i >= ref_size || key_of(x->pair) != ref[i]) fail("recorrido en orden distinto a la referencia");
+        if (x->left == NULL && x->right == NULL) {
+            check_path(tree, x);
+            int h = height(x);
+            if (h > max_height) max_height = h;
+        }
+        x = successor(x);
+        i++;
+    }
+    if (i != ref_size) fail("faltan datos en el recorrido");
+    return max_height;
+}
+
+TreeNode* find_node(TreeMap* tree, int key){
+    TreeNode* x = tree->root;
+    while (x != NULL && key_of(x->pair) != key) {
+        if (key < key_of(x->pair)) x = x->left;
+        else x = x->right;
+    }
+    return x;
+}
+
+// nodo mas profundo cuyo subarbol cambia al borrar x
+TreeNode* erase_point(TreeNode* x){
+    if (x == NULL) return NULL;
+    if (x->left != NULL && x->right != NULL) {
+        TreeNode* next = minimum(x->right);
+        return (next->parent == x) ? next : next->parent;
+    }
+    return x->parent;
+}
+
+// caminos a los vecinos de un rango borrado que empieza en ref[i]
+void check_gap(TreeMap* tree, int i){
+    if (i > 0) check_path(tree, find_node(tree, ref[i - 1]));
+    if (i < ref_size) check_path(tree, find_node(tree, ref[i]));
+}
+
+int height_bound(int n){
+    int lg = 0;
+    while ((1 << lg) <= n) lg++;
+    return 4 * lg + 8;
+}
+
+void step(TreeMap* tree, int op, int key){
+    TreeNode* touched = NULL;
+    Pair* p;
+    int i;
+
+    switch (op) {
+    case 2: {
+        Pair batch[8];
+        for (int j = 0; j < 8; j++) {
+            int k = (j == 0) ? key : rand() % universe;
+            batch[j].key = batch[j].value = &pool[k];
+            ref_insert(k);
+        }
+        insertBatchTreeMap(tree, batch, 8);
+        for (int j = 0; j < 8; j++) check_path(tree, find_node(tree, key_of(&batch[j])));
+        break;
+    }
+    case 0: case 1:
+        i = ref_size;
+        insertTreeMap(tree, &pool[key], &pool[key]);
+        ref_insert(key);
+        if (ref_size == i) break;
+        if (tree->current == NULL || key_of(tree->current->pair) != key) fail("insert no deja current en la clave");
+        touched = tree->current;
+        break;
+    case 3: case 4:
+        touched = erase_point(find_node(tree, key));
+        eraseTreeMap(tree, &pool[key]);
+        ref_erase(key);
+        break;
+    case 5:
+        p = searchTreeMap(tree, &pool[key]);
+        i = ref_lower(key);
+        if ((p != NULL) != (i < ref_size && ref[i] == key)) fail("search distinto a la referencia");
+        break;
+    case 6:
+        p = upperBound(tree, &pool[key]);
+        i = ref_lower(key);
+        if ((p == NULL) != (i == ref_size) || (p != NULL && key_of(p) != ref[i]))
+            fail("upperBound distinto a la referencia");
+        {
+            int hi = key + rand() % 64;
+            double expected = 0;
+            for (; i < ref_size && ref[i] <= hi; i++) expected += ref[i];
+            if (aggregateRange(tree, &pool[key], &hi) != expected) fail("aggregateRange distinto a la referencia");
+        }
+        break;
+    case 7:
+        p = seekFrom(tree, &pool[key]);
+        i = ref_lower(key);
+        for (int j = 0; j < 8; j++, i++) {
+            if ((p == NULL) != (i >= ref_size) || (p != NULL && key_of(p) != ref[i]))
+                fail("seekFrom/nextTreeMap distinto a la referencia");
+            if (p == NULL) break;
+            p = nextTreeMap(tree);
+        }
+        break;
+    case 8:
+        p = seekFrom(tree, &pool[key]);
+        i = ref_lower(key);
+        if (p != NULL) {
+            touched = erase_point(tree->current);
+            p = eraseAtIterator(tree);
+            ref_erase(ref[i]);
+            if ((p == NULL) != (i >= ref_size) || (p != NULL && key_of(p) != ref[i]))
+                fail("eraseAtIterator no retorna el sucesor");
+        }
+        break;
+    default: {
+        int hi = key + rand() % 16;
+        int lo_i = ref_lower(key), hi_i = ref_lower(hi + 1);
+        p = seekFrom(tree, &pool[rand() % universe]);
+        int cursor = (p != NULL) ? key_of(p) : -1;
+        released = 0;
+        if (eraseRangeTreeMap(tree, &pool[key], &hi, release_int) != hi_i - lo_i) fail("eraseRange borra una cantidad incorrecta");
+        if (released != hi_i - lo_i) fail("eraseRange no entrega todos los pares borrados");
+        memmove(ref + lo_i, ref + hi_i, (ref_size - hi_i) * sizeof(int));
+        ref_size -= hi_i - lo_i;
+        if (hi_i > lo_i) check_gap(tree, lo_i);
+        if (cursor >= key && cursor <= hi) {
+            if ((tree->current == NULL) != (lo_i == ref_size) ||
+                (tree->current != NULL && key_of(tree->current->pair) != ref[lo_i]))
+                fail("eraseRange no mueve current al sucesor del rango");
+        } else if ((tree->current == NULL) != (cursor < 0) ||
+                   (tree->current != NULL && key_of(tree->current->pair) != cursor)) {
+            fail("eraseRange mueve current aunque estaba fuera del rango");
+        }
+        break;
+    }
+    }
+
+    if (touched != NULL) check_path(tree, touched);
+    if (nodeSize(tree->root) != ref_size) fail("size de root distinto a la referencia");
+}
+
+void frozen_check(TreeMap* tree){
+    FrozenTreeMap* frozen = freezeTreeMap(tree);
+    if (frozen == NULL) fail("freezeTreeMap retorna NULL");
+
+    int i = 0;
+    for (Pair* p = firstFrozenTreeMap(frozen); p != NULL; p = nextFrozenTreeMap(frozen), i++) {
+        if (i >= ref_size || key_of(p) != ref[i]) fail("recorrido congelado distinto a la referencia");
+    }
+    if (i != ref_size) fail("recorrido congelado incompleto");
+
+    i = 0;
+    for (Pair* p = nextFrozenAfter(frozen, NULL); p != NULL; p = nextFrozenAfter(frozen, p), i++) {
+        if (i >= ref_size || key_of(p) != ref[i]) fail("recorrido con nextFrozenAfter distinto a la referencia");
+    }
+    if (i != ref_size) fail("recorrido con nextFrozenAfter incompleto");
+
+    for (int j = 0; j < 256; j++) {
+        int key = rand() % (universe + 2) - 1;
+        int k = ref_lower(key);
+        Pair* p = searchFrozenTreeMap(frozen, &key);
+        if ((p != NULL) != (k < ref_size && ref[k] == key)) fail("searchFrozenTreeMap distinto a la referencia");
+        p = upperBoundFrozen(frozen, &key);
+        if ((p == NULL) != (k == ref_size) || (p != NULL && key_of(p) != ref[k]))
+            fail("upperBoundFrozen distinto a la referencia");
+        if (p != NULL && k + 1 < ref_size && key_of(nextFrozenAfter(frozen, p)) != ref[k + 1])
+            fail("nextFrozenAfter despues de upperBoundFrozen");
+        if (p != NULL && k + 1 == ref_size && nextFrozenAfter(frozen, p) != NULL)
+            fail("nextFrozenAfter despues del ultimo dato");
+    }
+
+    freeFrozenTreeMap(frozen);
+}
+
+void set_check(TreeMap* result, char* in, char* name){
+    int n = 0;
+    TreeNode* x = minimum(result->root);
+    for (int k = 0; k < universe; k++) {
+        if (!in[k]) continue;
+        if (x == NULL || key_of(x->pair) != k) {
+            sprintf(msg, "%s distinto a la referencia", name);
+            fail(msg);
+        }
+        x = successor(x);
+        n++;
+    }
+    if (x != NULL || nodeSize(result->root) != n) {
+        sprintf(msg, "%s tiene datos de mas", name);
+        fail(msg);
+    }
+    destroyTreeMap(result);
+}
+
+typedef struct {
+    int* key;
+    void** value_a;
+    void** value_b;
+    int size;
+    int calls;
+} JoinCheck;
+
+void join_expect(JoinCheck* check, int key, void* value_a, void* value_b){
+    check->key[check->size] = key;
+    check->value_a[check->size] = value_a;
+    check->value_b[check->size++] = value_b;
+}
+
+void join_callback(void* key, void* value_a, void* value_b, void* data){
+    JoinCheck* check = (JoinCheck*) data;
+    int i = check->calls++;
+    if (i >= check->size || *((int*) key) != check->key[i] ||
+        value_a != check->value_a[i] || value_b != check->value_b[i])
+        fail("joinTreeMap entrega pares distintos a la referencia");
+}
+
+void join_run(JoinCheck* check, TreeMap* a, TreeMap* b, char* name){
+    check->calls = 0;
+    int count = joinTreeMap(a, b, join_callback, check);
+    if (check->calls != check->size || count != check->size) {
+        sprintf(msg, "%s: %d pares y count %d en vez de %d", name, check->calls, count, check->size);
+        fail(msg);
+    }
+    check->size = 0;
+}
+
+// joinTreeMap con repetidos a ambos lados; b_values[b_start[k]..b_start[k+1]) son
+// los valores de la clave k en b, en orden de insercion
+void join_test(TreeMap* a, TreeMap* b, char* in_a, int* b_start, void** b_values){
+    int total = 0;
+    for (int k = 0; k < universe; k++) {
+        int n = b_start[k + 1] - b_start[k];
+        total += n * n + n;
+    }
+
+    JoinCheck check;
+    check.key = (int*) malloc(total * sizeof(int) + 1);
+    check.value_a = (void**) malloc(total * sizeof(void*) + 1);
+    check.value_b = (void**) malloc(total * sizeof(void*) + 1);
+    check.size = 0;
+
+    for (int k = 0; k < universe; k++) {
+        if (!in_a[k]) continue;
+        for (int j = b_start[k]; j < b_start[k + 1]; j++) join_expect(&check, k, &pool[k], b_values[j]);
+    }
+    join_run(&check, a, b, "joinTreeMap(a, b)");
+
+    for (int k = 0; k < universe; k++) {
+        if (!in_a[k]) continue;
+        for (int j = b_start[k]; j < b_start[k + 1]; j++) join_expect(&check, k, b_values[j], &pool[k]);
+    }
+    join_run(&check, b, a, "joinTreeMap(b, a)");
+
+    for (int k = 0; k < universe; k++) {
+        for (int i = b_start[k]; i < b_start[k + 1]; i++) {
+            for (int j = b_start[k]; j < b_start[k + 1]; j++) join_expect(&check, k, b_values[i], b_values[j]);
+        }
+    }
+    join_run(&check, b, b, "joinTreeMap(b, b)");
+
+    free(check.key);
+    free(check.value_a);
+    free(check.value_b);
+}
+
+// a es el arbol de la prueba, b un multimapa con claves al azar
+void set_test(TreeMap* a){
+    TreeMap* b = createMultiTreeMap(lower_than_int);
+    char* in_a = (char*) calloc(universe, 1);
+    char* in_b = (char*) calloc(universe, 1);
+    char* expected = (char*) malloc(universe);
+    int* b_keys = (int*) malloc(2 * universe * sizeof(int));
+    int* b_ids = (int*) malloc(2 * universe * sizeof(int));
+    int* b_start = (int*) calloc(universe + 1, sizeof(int));
+    void** b_values = (void**) malloc(2 * universe * sizeof(void*));
+
+    for (int i = 0; i < ref_size; i++) in_a[ref[i]] = 1;
+    for (int i = 0; i < 2 * universe; i += 2) {
+        int k = rand() % universe;
+        b_keys[i] = b_keys[i + 1] = k;
+        b_ids[i] = i;
+        b_ids[i + 1] = i + 1;
+        insertTreeMap(b, &pool[k], &b_ids[i]);
+        insertTreeMap(b, &pool[k], &b_ids[i + 1]);
+        b_start[k + 1] += 2;
+        in_b[k] = 1;
+    }
+    for (int k = 0; k < universe; k++) b_start[k + 1] += b_start[k];
+    {
+        int* next = (int*) malloc(universe * sizeof(int));
+        memcpy(next, b_start, universe * sizeof(int));
+        for (int i = 0; i < 2 * universe; i++) b_values[next[b_keys[i]]++] = &b_ids[i];
+        free(next);
+    }
+
+    for (int k = 0; k < universe; k++) expected[k] = in_a[k] || in_b[k];
+    set_check(unionTreeMap(a, b), expected, "unionTreeMap");
+    for (int k = 0; k < universe; k++) expected[k] = in_a[k] && in_b[k];
+    set_check(intersectTreeMap(a, b), expected, "intersectTreeMap");
+    for (int k = 0; k < universe; k++) expected[k] = in_a[k] && !in_b[k];
+    set_check(differenceTreeMap(a, b), expected, "differenceTreeMap");
+    join_test(a, b, in_a, b_start, b_values);
+
+    destroyTreeMap(b);
+    free(in_a);
+    free(in_b);
+    free(expected);
+    free(b_keys);
+    free(b_ids);
+    free(b_start);
+    free(b_values);
+}
+
+#define MULTI_KEYS 64
+#define MULTI_CAP 32
+
+int multi_ref[MULTI_KEYS][MULTI_CAP];   // valores de cada clave en orden de insercion
+int multi_count[MULTI_KEYS];
+
+void multi_check_key(TreeMap* tree, int key){
+    int count;
+    Pair* p = equalRange(tree, &pool[key], &count);
+
+    if (countKey(tree, &pool[key]) != multi_count[key]) fail("countKey distinto a la referencia");
+    if (count != multi_count[key]) fail("equalRange retorna una cantidad incorrecta");
+    for (int j = 0; j < count; j++) {
+        if (p == NULL || key_of(p) != key || *((int*) p->value) != multi_ref[key][j])
+            fail("equalRange no respeta el orden de insercion");
+        p = nextTreeMap(tree);
+    }
+    if (p != NULL && key_of(p) == key) fail("equalRange no cubre todos los repetidos");
+
+    p = searchTreeMap(tree, &pool[key]);
+    if ((p == NULL) != (multi_count[key] == 0) || (p != NULL && *((int*) p->value) != multi_ref[key][0]))
+        fail("search no retorna el repetido mas antiguo");
+    p = upperBound(tree, &pool[key]);
+    if (multi_count[key] > 0 && (p == NULL || *((int*) p->value) != multi_ref[key][0]))
+        fail("upperBound no retorna el repetido mas antiguo");
+}
+
+void multi_test(long ops){
+    TreeMap* tree = createMultiTreeMap(lower_than_int);
+    int* values = (int*) malloc(ops * 8 * sizeof(int));
+    int used = 0;
+
+    memset(multi_count, 0, sizeof(multi_count));
+    for (long n = 0; n < ops; n++) {
+        int key = rand() % MULTI_KEYS;
+        int op = rand() % 4;
+
+        if (op == 0 && multi_count[key] < MULTI_CAP) {
+            values[used] = used;
+            insertTreeMap(tree, &pool[key], &values[used]);
+            multi_ref[key][multi_count[key]++] = used++;
+        } else if (op == 1) {
+            Pair batch[8];
+            int m = 0;
+            for (int j = 0; j < 8; j++) {
+                int k = (j == 0 || rand() % 2) ? key : rand() % MULTI_KEYS;
+                if (multi_count[k] == MULTI_CAP) continue;
+                values[used] = used;
+                batch[m].key = &pool[k];
+                batch[m++].value = &values[used];
+                multi_ref[k][multi_count[k]++] = used++;
+            }
+            insertBatchTreeMap(tree, batch, m);
+        } else if (op == 2 && multi_count[key] > 0) {
+            eraseTreeMap(tree, &pool[key]);
+            memmove(multi_ref[key], multi_ref[key] + 1, (multi_count[key] - 1) * sizeof(int));
+            multi_count[key]--;
+        }
+        multi_check_key(tree, key);
+    }
+
+    for (int k = 0; k < MULTI_KEYS; k++) multi_check_key(tree, k);
+    destroyTreeMap(tree);
+    free(values);
+    ok_msg("multimapa consistente con la referencia (equalRange, countKey, search)");
+}
+
+#define CACHE_KEYS 64
+#define CACHE_CAP 16
+
+long fake_now = 1;
+long cache_tick = 0;
+int cache_in[CACHE_KEYS];       // presente en el mapa, vencido o no
+long cache_expires[CACHE_KEYS];
+long cache_stamp[CACHE_KEYS];   // ultimo insert o search exitoso
+int evicted = 0;
+
+long fake_clock(void){
+    return fake_now;
+}
+
+int cache_live(int key){
+    return cache_in[key] && (cache_expires[key] == 0 || cache_expires[key] > fake_now);
+}
+
+void evict_int(void* key, void* value){
+    int k = *((int*) key);
+    if (key != value) fail("evict entrega un par distinto");
+    if (!cache_in[k]) fail("evict entrega una clave que no estaba");
+    if (cache_live(k)) {
+        for (int j = 0; j < CACHE_KEYS; j++) {
+            if (cache_in[j] && cache_stamp[j] < cache_stamp[k]) fail("la capacidad no expulsa la clave menos usada");
+        }
+    }
+    cache_in[k] = 0;
+    evicted++;
+}
+
+void release_cache(void* key, void* value){
+    cache_in[*((int*) key)] = 0;
+}
+
+// primera clave viva >= key, o CACHE_KEYS
+int cache_next(int key){
+    while (key < CACHE_KEYS && !cache_live(key)) key++;
+    return key;
+}
+
+void cache_check(TreeMap* tree){
+    int present = 0;
+    for (int k = 0; k < CACHE_KEYS; k++) present += cache_in[k];
+    if (nodeSize(tree->root) != present) fail("cache: el mapa pierde datos sin llamar a evict");
+    if (present > CACHE_CAP) fail("cache: supera la capacidad");
+
+    int n = 0;
+    for (TreeNode* x = tree->oldest; x != NULL; x = x->newer, n++) {
+        if (x->newer != NULL && x->newer->older != x) fail("cache: lista LRU inconsistente");
+    }
+    if (n != present) fail("cache: lista LRU con tamano distinto al mapa");
+
+    for (TreeNode* x = minimum(tree->root); x != NULL; x = successor(x)) {
+        if (x->left == NULL && x->right == NULL) check_path(tree, x);
+    }
+}
+
+void cache_test(long ops){
+    TreeMap* tree = createTreeMap(lower_than_int);
+    setAggregateTreeMap(tree, measure_int, sum, 0);
+    setCacheTreeMap(tree, CACHE_CAP, evict_int, fake_clock);
+    memset(cache_in, 0, sizeof(cache_in));
+
+    for (long n = 0; n < ops; n++) {
+        int key = rand() % CACHE_KEYS;
+        int i, hi;
+        Pair* p;
+        fake_now += rand() % 2;
+
+        switch (rand() % 9) {
+        case 0: case 1:
+            if (!cache_in[key]) {
+                long ttl = (rand() % 2) ? 1 + rand() % 16 : 0;
+                cache_in[key] = 1;
+                cache_expires[key] = (ttl > 0) ? fake_now + ttl : 0;
+                cache_stamp[key] = ++cache_tick;
+                insertTreeMapTTL(tree, &pool[key], &pool[key], ttl);
+            } else {
+                insertTreeMap(tree, &pool[key], &pool[key]);
+            }
+            break;
+        case 2:
+            i = cache_live(key);
+            p = searchTreeMap(tree, &pool[key]);
+            if ((p != NULL) != i) fail("cache: search distinto a la referencia");
+            if (p != NULL) cache_stamp[key] = ++cache_tick;
+            break;
+        case 3:
+            cache_in[key] = 0;
+            eraseTreeMap(tree, &pool[key]);
+            break;
+        case 4:
+            i = cache_next(key);
+            p = upperBound(tree, &pool[key]);
+            if ((p == NULL) != (i == CACHE_KEYS) || (p != NULL && key_of(p) != i))
+                fail("cache: upperBound retorna una clave vencida o ausente");
+            break;
+        case 5:
+            i = cache_next(key);
+            p = seekFrom(tree, &pool[key]);
+            for (int j = 0; j < 8; j++) {
+                if ((p == NULL) != (i == CACHE_KEYS) || (p != NULL && key_of(p) != i))
+                    fail("cache: seekFrom/nextTreeMap retorna una clave vencida o ausente");
+                if (p == NULL) break;
+                fake_now += rand() % 2;
+                i = cache_next(i + 1);
+                p = nextTreeMap(tree);
+            }
+            break;
+        case 6:
+            if (countKey(tree, &pool[key]) != cache_live(key)) fail("cache: countKey cuenta una clave vencida");
+            hi = key + rand() % 16;
+            {
+                double expected = 0;
+                for (int k = key; k <= hi && k < CACHE_KEYS; k++) if (cache_live(k)) expected += k;
+                if (aggregateRange(tree, &pool[key], &hi) != expected)
+                    fail("cache: aggregateRange suma claves vencidas");
+            }
+            break;
+        case 7:
+            i = cache_next(0);
+            for (p = firstTreeMap(tree); p != NULL; p = nextTreeMap(tree)) {
+                if (i == CACHE_KEYS || key_of(p) != i) fail("cache: recorrido con claves vencidas o ausentes");
+                i = cache_next(i + 1);
+            }
+            if (i != CACHE_KEYS) fail("cache: recorrido incompleto");
+            break;
+        default:
+            hi = key + rand() % 4;
+            if (hi >= CACHE_KEYS) hi = CACHE_KEYS - 1;
+            eraseRangeTreeMap(tree, &pool[key], &hi, release_cache);
+            for (int k = key; k <= hi; k++) if (cache_in[k]) fail("cache: eraseRange deja claves del rango");
+            break;
+        }
+        cache_check(tree);
+    }
+
+    if (evicted == 0) fail("cache: evict nunca se llamo");
+    destroyTreeMap(tree);
+    sprintf(msg, "cache LRU/TTL consistente con la referencia (%d expulsiones)", evicted);
+    ok_msg(msg);
+}
+
+#define lower_than_value(a, b) ((a) < (b))
+DEFINE_TREEMAP(IntMap, int, int, lower_than_value)
+
+// IntMap contra un TreeMap con las mismas operaciones
+void gen_test(long ops){
+    IntMap* map = createIntMap();
+    TreeMap* tree = createTreeMap(lower_than_int);
+
+    for (long n = 0; n < ops; n++) {
+        int key = rand() % universe;
+        IntMapNode* node;
+        Pair* p;
+
+        switch (rand() % 5) {
+        case 0: case 1:
+            insertIntMap(map, key, -key);
+            insertTreeMap(tree, &pool[key], &pool[key]);
+            break;
+        case 2:
+            eraseIntMap(map, key);
+            eraseTreeMap(tree, &pool[key]);
+            break;
+        case 3:
+            node = searchIntMap(map, key);
+            p = searchTreeMap(tree, &pool[key]);
+            if ((node != NULL) != (p != NULL) || (node != NULL && node->value != -key))
+                fail("IntMap: search distinto a TreeMap");
+            break;
+        default:
+            node = upperBoundIntMap(map, key);
+            p = upperBound(tree, &pool[key]);
+            if ((node != NULL) != (p != NULL) || (node != NULL && node->key != key_of(p)))
+                fail("IntMap: upperBound distinto a TreeMap");
+            break;
+        }
+        if (map->size != nodeSize(tree->root)) fail("IntMap: size distinto a TreeMap");
+        if ((map->current == NULL) != (tree->current == NULL) ||
+            (map->current != NULL && map->current->key != key_of(tree->current->pair)))
+            fail("IntMap: current distinto a TreeMap");
+
+        if (n % FULL_CHECK == 0) {
+            p = firstTreeMap(tree);
+            for (node = firstIntMap(map); node != NULL; node = nextIntMap(map)) {
+                if (p == NULL || node->key != key_of(p)) fail("IntMap: recorrido distinto a TreeMap");
+                if ((node->left != NULL && node->left->parent != node) || (node->right != NULL && node->right->parent != node))
+                    fail("IntMap: parent desactualizado");
+                p = nextTreeMap(tree);
+            }
+            if (p != NULL) fail("IntMap: recorrido incompleto");
+        }
+    }
+
+    destroyIntMap(map);
+    destroyTreeMap(tree);
+    ok_msg("DEFINE_TREEMAP consistente con TreeMap");
+}
+
+#define LOG_KEYS 64
+#define LOG_CAP 32
+#define LOG_GROUP 8
+#define LOG_PATH "stress_log"
+
+int log_ref[LOG_KEYS][LOG_CAP];   // valores de cada clave en orden de insercion
+int log_count[LOG_KEYS];
+int log_value = 0;
+int log_pending = 0;
+
+void write_int(FILE* file, void* x){
+    fwrite(x, sizeof(int), 1, file);
+}
+
+void* read_int(FILE* file){
+    int* x = (int*) malloc(sizeof(int));
+    if (fread(x, sizeof(int), 1, file) != 1) *x = -1;
+    return x;
+}
+
+TreeMapCodec int_codec = {write_int, write_int, read_int, read_int, free, free};
+
+int* new_int(int x){
+    int* aux = (int*) malloc(sizeof(int));
+    *aux = x;
+    return aux;
+}
+
+char* read_file(const char* path, long* size){
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) fail("log: no se puede leer el archivo");
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = (char*) malloc(*size + 1);
+    if (fread(data, 1, *size, file) != (size_t) *size) fail("log: lectura incompleta");
+    fclose(file);
+    return data;
+}
+
+void write_file(const char* path, char* data, long size){
+    FILE* file = fopen(path, "wb");
+    if (file == NULL || fwrite(data, 1, size, file) != (size_t) size) fail("log: no se puede escribir el archivo");
+    fclose(file);
+}
+
+void remove_log(void){
+    remove(LOG_PATH);
+    remove(LOG_PATH ".ckpt");
+    remove(LOG_PATH ".tmp");
+}
+
+TreeMapLog* log_open(TreeMap** tree, int multi){
+    *tree = multi ? createMultiTreeMap(lower_than_int) : createTreeMap(lower_than_int);
+    TreeMapLog* log = openTreeMapLog(*tree, LOG_PATH, int_codec, LOG_GROUP);
+    if (log == NULL) fail("log: openTreeMapLog retorna NULL");
+    log_pending = 0;
+    return log;
+}
+
+// cierra el log y libera el mapa junto con sus claves y valores
+void log_close(TreeMap* tree, TreeMapLog* log){
+    closeTreeMapLog(log);
+    for (Pair* p = firstTreeMap(tree); p != NULL; p = nextTreeMap(tree)) {
+        free(p->key);
+        free(p->value);
+    }
+    destroyTreeMap(tree);
+}
+
+void log_check(TreeMap* tree, char* name){
+    Pair* p = firstTreeMap(tree);
+    for (int k = 0; k < LOG_KEYS; k++) {
+        for (int j = 0; j < log_count[k]; j++, p = nextTreeMap(tree)) {
+            if (p == NULL || key_of(p) != k || *((int*) p->value) != log_ref[k][j]) {
+                sprintf(msg, "log: %s distinto a la referencia", name);
+                fail(msg);
+            }
+        }
+    }
+    if (p != NULL) {
+        sprintf(msg, "log: %s tiene datos de mas", name);
+        fail(msg);
+    }
+}
+
+void log_step(TreeMap* tree, TreeMapLog* log){
+    int key = rand() % LOG_KEYS;
+    int op = rand() % 3;
+    int status = 1;
+
+    if (op < 2 && log_count[key] == LOG_CAP) return;
+    if (op == 0) {
+        status = logInsertTreeMap(log, new_int(key), new_int(++log_value));
+        if (tree->multi || log_count[key] == 0) log_ref[key][log_count[key]++] = log_value;
+    } else if (op == 1) {
+        status = logUpdateTreeMap(log, new_int(key), new_int(++log_value));
+        if (!tree->multi && log_count[key] > 0) log_ref[key][0] = log_value;
+        else log_ref[key][log_count[key]++] = log_value;
+    } else {
+        status = logEraseTreeMap(log, &pool[key]);
+        if (log_count[key] > 0) {
+            memmove(log_ref[key], log_ref[key] + 1, (log_count[key] - 1) * sizeof(int));
+            log_count[key]--;
+        }
+    }
+    if (status != 1) fail("log: la escritura falla");
+
+    log_pending = (log_pending + 1) % LOG_GROUP;
+    if (log->pending != log_pending) fail("log: el fsync en grupo no respeta el tamano del grupo");
+}
+
+void log_test(int multi){
+    TreeMap* tree;
+    TreeMapLog* log;
+    long size;
+    char* data;
+
+    remove_log();
+    memset(log_count, 0, sizeof(log_count));
+
+    // operaciones al azar con checkpoints y syncs intermedios
+    log = log_open(&tree, multi);
+    for (int n = 1; n <= 2000; n++) {
+        log_step(tree, log);
+        if (n % 97 == 0) {
+            if (!syncTreeMapLog(log) || log->pending != 0) fail("log: syncTreeMapLog no vacia el grupo");
+            log_pending = 0;
+        }
+        if (n % 500 == 0) {
+            if (!checkpointTreeMap(log)) fail("log: checkpointTreeMap falla");
+            log_pending = 0;
+        }
+    }
+    log_check(tree, "mapa en uso");
+    log_close(tree, log);
+    log = log_open(&tree, multi);
+    log_check(tree, "recuperacion");
+
+    // un registro cortado a la mitad se descarta
+    for (int n = 0; n < 200; n++) log_step(tree, log);
+    int saved_ref[LOG_KEYS][LOG_CAP], saved_count[LOG_KEYS];
+    memcpy(saved_ref, log_ref, sizeof(log_ref));
+    memcpy(saved_count, log_count, sizeof(log_count));
+    logInsertTreeMap(log, new_int(0), new_int(++log_value));
+    log_close(tree, log);
+    data = read_file(LOG_PATH, &size);
+    write_file(LOG_PATH, data, size - sizeof(int) / 2 - 1);
+    free(data);
+    memcpy(log_ref, saved_ref, sizeof(log_ref));
+    memcpy(log_count, saved_count, sizeof(log_count));
+    log = log_open(&tree, multi);
+    log_check(tree, "recuperacion con el ultimo registro cortado");
+
+    // caida despues de renombrar el checkpoint y antes de truncar el log
+    for (int n = 0; n < 200; n++) log_step(tree, log);
+    syncTreeMapLog(log);
+    data = read_file(LOG_PATH, &size);
+    if (!checkpointTreeMap(log)) fail("log: checkpointTreeMap falla");
+    log_close(tree, log);
+    write_file(LOG_PATH, data, size);
+    free(data);
+    log = log_open(&tree, multi);
+    log_check(tree, "recuperacion con el log viejo junto al checkpoint");
+
+    log_close(tree, log);
+    remove_log();
+}
+
+int main( int argc, char *argv[] ) {
+    long ops = (argc > 1) ? atol(argv[1]) : 1000000;
+    unsigned seed = (argc > 2) ? (unsigned)atol(argv[2]) : (unsigned)time(NULL);
+    double budget = (argc > 3) ? atof(argv[3]) : 5000.0;
+    if (argc > 4) universe = atoi(argv[4]);
+    if (universe < MULTI_KEYS) universe = MULTI_KEYS;
+
+    printf("\nStress test: %ld operaciones, semilla %u, %d claves\n", ops, seed, universe);
+    srand(seed);
+    pool = (int*) malloc(universe * sizeof(int));
+    ref = (int*) malloc(universe * sizeof(int));
+    for (int k = 0; k < universe; k++) pool[k] = k;
+
+    TreeMap* tree = createTreeMap(lower_than_int);
+    setAggregateTreeMap(tree, measure_int, sum, 0);
+    int max_height = 0;
+    double worst = 0;
+    clock_t start = clock();
+
+    for (long n = 1; n <= ops; n++) {
+        int op = rand() % 10;
+        if (op == 9 && rand() % 8 != 0) op = rand() % 9;
+        step(tree, op, rand() % universe);
+
+        if (n % FULL_CHECK == 0) {
+            clock_t paused = clock();
+            int h = check_tree(tree);
+            if (n % (16 * FULL_CHECK) == 0) frozen_check(tree);
+            if (h > max_height) max_height = h;
+            if (h > height_bound(ref_size)) {
+                sprintf(msg, "altura %d supera la cota %d (n=%d)", h, height_bound(ref_size), ref_size);
+                fail(msg);
+            }
+            start += clock() - paused;
+        }
+
+        if (n % BATCH == 0) {
+            double ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / BATCH;
+            if (ns > worst) worst = ns;
+            if (ns > budget) {
+                sprintf(msg, "%.0f ns por operacion supera el presupuesto de %.0f ns", ns, budget);
+                fail(msg);
+            }
+            start = clock();
+        }
+    }
+
+    check_tree(tree);
+    frozen_check(tree);
+    ok_msg("arbol consistente con la referencia");
+    ok_msg("freezeTreeMap consistente con la referencia");
+    set_test(tree);
+    ok_msg("union, interseccion, diferencia y joinTreeMap consistentes con la referencia");
+    sprintf(msg, "altura maxima %d", max_height);
+    ok_msg(msg);
+    sprintf(msg, "peor lote %.0f ns por operacion (presupuesto %.0f ns)", worst, budget);
+    ok_msg(msg);
+
+    multi_test(ops / 10 + 1000);
+    cache_test(ops / 10 + 1000);
+    gen_test(ops / 10 + 1000);
+    log_test(0);
+    log_test(1);
+    ok_msg("log: recuperacion, registros cortados, fsync en grupo y checkpoints");
+    destroyTreeMap(tree);
+    free(pool);
+    free(ref);
+    printf("SUCCESS\n");
+    return 0;
+}
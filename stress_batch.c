@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "treemap.h"
+#include "batchmap.h"
+
+// uso: ./stress_batch [claves por productor] [semilla]
+
+#define PRODUCERS 8
+#define READERS 2
+#define STALENESS_MS 5
+
+BatchMap* batch;
+TreeMap* tree;
+int* keys;      // claves al azar sin repetir, PRODUCERS * per_producer
+int per_producer = 20000;
+atomic_int producing;
+
+char msg[300];
+
+void err_msg(char* msg){
+    printf("   [FAILED] ");
+    printf("%s\n",msg);
+}
+
+void ok_msg(char* msg){
+    printf ("   [OK] ");
+    printf("%s\n",msg);
+}
+
+int fail(char* msg){
+    err_msg(msg);
+    exit(1);
+}
+
+int lower_than_int(void* key1, void* key2){
+    int k1 = *((int*) (key1));
+    int k2 = *((int*) (key2));
+    return k1<k2;
+}
+
+double one(void* key, void* value){
+    return 1;
+}
+
+double sum(double a, double b){
+    return a + b;
+}
+
+int key_min = -1, key_max = 1 << 30;
+
+// cantidad de datos en el mapa, sin mover current
+int map_size(void){
+    return (int) aggregateRange(tree, &key_min, &key_max);
+}
+
+void sleep_ms(int ms){
+    struct timespec t = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&t, NULL);
+}
+
+void shuffle_keys(int n){
+    for (int i = 0; i < n; i++) keys[i] = i;
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int aux = keys[i];
+        keys[i] = keys[j];
+        keys[j] = aux;
+    }
+}
+
+// cada productor inserta su parte de keys y cada tanto pide un flush
+void* produce(void* arg){
+    int id = (int)(long) arg;
+    int* mine = keys + id * per_producer;
+    BatchProducer* producer = registerProducer(batch);
+    if (producer == NULL) fail("registerProducer retorna NULL");
+
+    unsigned seed = id + 1;
+    for (int i = 0; i < per_producer; i++) {
+        if (!batchInsert(producer, &mine[i], &mine[i])) fail("batchInsert rechaza un dato");
+        if (rand_r(&seed) % 4096 == 0) {
+            flushBatchMap(batch);
+            readLockBatchMap(batch);
+            for (int j = 0; j <= i; j += 97) {
+                Pair* p = upperBound(tree, &mine[j]);
+                if (p == NULL || *((int*) p->key) != mine[j]) fail("flushBatchMap retorna antes de aplicar lo enviado");
+            }
+            readUnlockBatchMap(batch);
+        }
+    }
+    atomic_fetch_sub(&producing, 1);
+    return NULL;
+}
+
+// los lectores solo usan llamadas sin cursor bajo readLockBatchMap
+void* read_shared(void* arg){
+    int last = 0;
+    unsigned seed = (unsigned)(long) arg;
+
+    while (atomic_load(&producing) > 0) {
+        readLockBatchMap(batch);
+        int n = map_size();
+        int key = rand_r(&seed) % (PRODUCERS * per_producer);
+        Pair* p = upperBound(tree, &key);
+        if (p != NULL && *((int*) p->key) < key) fail("upperBound concurrente retorna una clave menor");
+        if (countKey(tree, &key) > 1) fail("countKey concurrente cuenta repetidos");
+        readUnlockBatchMap(batch);
+        if (n < last) fail("el mapa pierde datos entre lecturas");
+        last = n;
+
+        lockBatchMap(batch);
+        p = searchTreeMap(tree, &key);
+        if (p != NULL) {
+            p = nextTreeMap(tree);
+            if (p != NULL && *((int*) p->key) <= key) fail("nextTreeMap bajo lockBatchMap fuera de orden");
+        }
+        unlockBatchMap(batch);
+    }
+    return NULL;
+}
+
+void check_all(int n, char* name){
+    int i = 0;
+    for (Pair* p = firstTreeMap(tree); p != NULL; p = nextTreeMap(tree), i++) {
+        if (*((int*) p->key) != i) {
+            sprintf(msg, "%s: falta la clave %d", name, i);
+            fail(msg);
+        }
+    }
+    if (i != n) {
+        sprintf(msg, "%s: %d datos en vez de %d", name, i, n);
+        fail(msg);
+    }
+}
+
+void test_producers(void){
+    int n = PRODUCERS * per_producer;
+    pthread_t producers[PRODUCERS], readers[READERS];
+
+    tree = createTreeMap(lower_than_int);
+    setAggregateTreeMap(tree, one, sum, 0);
+    batch = createBatchMap(tree, 256, STALENESS_MS);
+    if (batch == NULL) fail("createBatchMap retorna NULL");
+    shuffle_keys(n);
+
+    atomic_store(&producing, PRODUCERS);
+    for (long i = 0; i < READERS; i++) pthread_create(&readers[i], NULL, read_shared, (void*) (i + 1));
+    for (long i = 0; i < PRODUCERS; i++) pthread_create(&producers[i], NULL, produce, (void*) i);
+    for (int i = 0; i < PRODUCERS; i++) pthread_join(producers[i], NULL);
+    for (int i = 0; i < READERS; i++) pthread_join(readers[i], NULL);
+
+    flushBatchMap(batch);
+    check_all(n, "varios productores");
+    destroyBatchMap(batch);
+    destroyTreeMap(tree);
+    sprintf(msg, "%d productores y %d lectores insertan %d claves al azar", PRODUCERS, READERS, n);
+    ok_msg(msg);
+}
+
+// sin flush, el aplicador debe vaciar los buffers por tiempo
+void test_staleness(void){
+    int n = 1000;
+    tree = createTreeMap(lower_than_int);
+    setAggregateTreeMap(tree, one, sum, 0);
+    batch = createBatchMap(tree, 4096, STALENESS_MS);
+    shuffle_keys(n);
+
+    BatchProducer* producer = registerProducer(batch);
+    for (int i = 0; i < n; i++) batchInsert(producer, &keys[i], &keys[i]);
+
+    int size = 0;
+    for (int waited = 0; waited < 1000 && size < n; waited += STALENESS_MS) {
+        sleep_ms(STALENESS_MS);
+        readLockBatchMap(batch);
+        size = map_size();
+        readUnlockBatchMap(batch);
+    }
+    if (size != n) fail("el aplicador no vacia los buffers despues de staleness_ms");
+
+    destroyBatchMap(batch);
+    destroyTreeMap(tree);
+    ok_msg("staleness_ms aplica los datos sin flushBatchMap");
+}
+
+// destroyBatchMap aplica lo que quede en los buffers
+void test_destroy(void){
+    int n = 4000;
+    tree = createTreeMap(lower_than_int);
+    batch = createBatchMap(tree, 4096, 60000);
+    shuffle_keys(n);
+
+    BatchProducer* first = registerProducer(batch);
+    BatchProducer* second = registerProducer(batch);
+    for (int i = 0; i < n; i++) batchInsert((i % 2) ? first : second, &keys[i], &keys[i]);
+    destroyBatchMap(batch);
+
+    check_all(n, "destroyBatchMap");
+    destroyTreeMap(tree);
+    ok_msg("destroyBatchMap aplica los buffers pendientes");
+}
+
+// en un multimapa cada productor conserva el orden de sus repetidos
+void test_order(void){
+    int n = 2000;
+    tree = createMultiTreeMap(lower_than_int);
+    batch = createBatchMap(tree, 64, STALENESS_MS);
+    int* values = (int*) malloc(2 * n * sizeof(int));
+    int same[2] = {0, 1};
+
+    BatchProducer* producer[2] = {registerProducer(batch), registerProducer(batch)};
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < 2; j++) {
+            values[2 * i + j] = i;
+            batchInsert(producer[j], &same[rand() % 2], &values[2 * i + j]);
+        }
+        if (rand() % 256 == 0) flushBatchMap(batch);
+    }
+    destroyBatchMap(batch);
+
+    for (int k = 0; k < 2; k++) {
+        int count;
+        int last[2] = {-1, -1};
+        Pair* p = equalRange(tree, &same[k], &count);
+        for (int i = 0; i < count; i++, p = nextTreeMap(tree)) {
+            int j = (int)((int*) p->value - values) % 2;
+            if (*((int*) p->value) <= last[j]) fail("los repetidos de un productor cambian de orden");
+            last[j] = *((int*) p->value);
+        }
+    }
+
+    destroyTreeMap(tree);
+    free(values);
+    ok_msg("los repetidos de cada productor quedan en orden de envio");
+}
+
+#define SHORT_LIVED 200
+#define SHORT_KEYS 50
+
+// productores de vida corta, muchos mas que los lugares disponibles
+void* produce_once(void* arg){
+    int* mine = (int*) arg;
+    BatchProducer* producer = registerProducer(batch);
+    if (producer == NULL) fail("registerProducer no recicla los lugares liberados");
+    for (int i = 0; i < SHORT_KEYS; i++) {
+        if (!batchInsert(producer, &mine[i], &mine[i])) fail("batchInsert rechaza un dato");
+    }
+    unregisterProducer(producer);
+    return NULL;
+}
+
+void test_unregister(void){
+    int n = SHORT_LIVED * SHORT_KEYS;
+    pthread_t threads[4];
+
+    tree = createTreeMap(lower_than_int);
+    batch = createBatchMap(tree, 16, 60000);
+    shuffle_keys(n);
+
+    for (int round = 0; round < SHORT_LIVED / 4; round++) {
+        for (int i = 0; i < 4; i++) {
+            pthread_create(&threads[i], NULL, produce_once, keys + (4 * round + i) * SHORT_KEYS);
+        }
+        for (int i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+    }
+    if (batchInsert(NULL, &keys[0], &keys[0])) fail("batchInsert acepta un productor NULL");
+
+    readLockBatchMap(batch);
+    int present = 1;
+    for (int i = 0; i < n && present; i++) present = (countKey(tree, &keys[i]) == 1);
+    readUnlockBatchMap(batch);
+    if (!present) fail("unregisterProducer no aplica lo enviado antes de liberar el buffer");
+
+    destroyBatchMap(batch);
+    destroyTreeMap(tree);
+    sprintf(msg, "%d productores de vida corta reciclan sus lugares con unregisterProducer", SHORT_LIVED);
+    ok_msg(msg);
+}
+
+FrozenTreeMap* frozen;
+int frozen_size;
+
+// varios lectores recorren el mismo mapa congelado sin candado
+void* read_frozen(void* arg){
+    unsigned seed = (unsigned)(long) arg;
+    for (int n = 0; n < 2000; n++) {
+        int key = rand_r(&seed) % frozen_size;
+        Pair* p = searchFrozenTreeMap(frozen, &key);
+        if (p == NULL || *((int*) p->key) != key) fail("searchFrozenTreeMap concurrente no encuentra la clave");
+        p = upperBoundFrozen(frozen, &key);
+        for (int i = key; i < key + 8 && i < frozen_size; i++, p = nextFrozenAfter(frozen, p)) {
+            if (p == NULL || *((int*) p->key) != i) fail("nextFrozenAfter concurrente fuera de orden");
+        }
+    }
+    return NULL;
+}
+
+void test_frozen(void){
+    pthread_t readers[4];
+    frozen_size = 4000;
+    tree = createTreeMap(lower_than_int);
+    shuffle_keys(frozen_size);
+    for (int i = 0; i < frozen_size; i++) insertTreeMap(tree, &keys[i], &keys[i]);
+    frozen = freezeTreeMap(tree);
+
+    for (long i = 0; i < 4; i++) pthread_create(&readers[i], NULL, read_frozen, (void*) (i + 1));
+    for (int i = 0; i < 4; i++) pthread_join(readers[i], NULL);
+
+    freeFrozenTreeMap(frozen);
+    destroyTreeMap(tree);
+    ok_msg("4 lectores comparten un mapa congelado sin candado");
+}
+
+int main( int argc, char *argv[] ) {
+    if (argc > 1) per_producer = atoi(argv[1]);
+    unsigned seed = (argc > 2) ? (unsigned)atol(argv[2]) : (unsigned)time(NULL);
+
+    if (PRODUCERS * per_producer < SHORT_LIVED * SHORT_KEYS) per_producer = SHORT_LIVED * SHORT_KEYS / PRODUCERS;
+
+    printf("\nStress test de batchmap: %d claves por productor, semilla %u\n", per_producer, seed);
+    srand(seed);
+    keys = (int*) malloc(PRODUCERS * per_producer * sizeof(int));
+
+    test_producers();
+    test_staleness();
+    test_destroy();
+    test_order();
+    test_unregister();
+    test_frozen();
+
+    free(keys);
+    printf("SUCCESS\n");
+    return 0;
+}
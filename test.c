@@ -57,7 +57,7 @@ int lower_than_int(void* key1, void* key2){
 
 TreeMap* initializeTree(){
     info_msg("inicializando el arbol...");
-    TreeMap* tree=(TreeMap *)malloc(sizeof(TreeMap));
+    TreeMap* tree=(TreeMap *)calloc(1, sizeof(TreeMap));
     tree->lower_than = lower_than_int;
     Palabra* p=creaPalabra(5239,"auto");
     tree->root=createTreeNode(&p->id, p);
@@ -1,6 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "treemap.h"
 
 typedef struct TreeNode TreeNode;
@@ -11,12 +18,29 @@ struct TreeNode {
     TreeNode * left;
     TreeNode * right;
     TreeNode * parent;
+    int size;
+    double aggregate;
+    TreeNode * older;
+    TreeNode * newer;
+    long expires;
+    long soonest;
 };
 
 struct TreeMap {
     TreeNode * root;
     TreeNode * current;
     int (*lower_than) (void* key1, void* key2);
+    int multi;
+    double (*measure) (void* key, void* value);
+    double (*combine) (double a, double b);
+    double identity;
+    int cache;
+    int capacity;
+    TreeNode * oldest;
+    TreeNode * newest;
+    TreeNode * hand;
+    void (*evict) (void* key, void* value);
+    long (*now) (void);
 };
 
 int is_equal(TreeMap* tree, void* key1, void* key2){
@@ -33,6 +57,11 @@ TreeNode * createTreeNode(void* key, void * value) {
     new->pair->key = key;
     new->pair->value = value;
     new->parent = new->left = new->right = NULL;
+    new->size = 1;
+    new->aggregate = 0;
+    new->older = new->newer = NULL;
+    new->expires = 0;
+    new->soonest = 0;
     return new;
 }
 
@@ -44,38 +73,134 @@ TreeMap* createTreeMap(int (*lower_than)(void* key1, void* key2)) {
 
     newTreeMap->root = newTreeMap->current = NULL;
     newTreeMap->lower_than = lower_than;
+    newTreeMap->multi = 0;
+    newTreeMap->measure = NULL;
+    newTreeMap->combine = NULL;
+    newTreeMap->identity = 0;
+    newTreeMap->cache = 0;
+    newTreeMap->capacity = 0;
+    newTreeMap->oldest = newTreeMap->newest = newTreeMap->hand = NULL;
+    newTreeMap->evict = NULL;
+    newTreeMap->now = NULL;
 
     return newTreeMap;
 }
 
 
-void insertTreeMap(TreeMap * tree, void* key, void * value){
+TreeMap* createMultiTreeMap(int (*lower_than)(void* key1, void* key2)) {
+    TreeMap* newTreeMap = createTreeMap(lower_than);
+    if (newTreeMap == NULL) return NULL;
+
+    newTreeMap->multi = 1;
+    return newTreeMap;
+}
+
+
+int nodeSize(TreeNode* x) {
+    return (x == NULL) ? 0 : x->size;
+}
+
+
+double nodeAggregate(TreeMap * tree, TreeNode* x) {
+    return (x == NULL) ? tree->identity : x->aggregate;
+}
+
+
+long nodeSoonest(TreeNode* x) {
+    return (x == NULL) ? 0 : x->soonest;
+}
+
+
+long sooner(long a, long b) {
+    if (a == 0) return b;
+    if (b == 0) return a;
+    return (a < b) ? a : b;
+}
+
+
+void updateNode(TreeMap * tree, TreeNode* x) {
+    x->size = 1 + nodeSize(x->left) + nodeSize(x->right);
+    x->soonest = sooner(x->expires, sooner(nodeSoonest(x->left), nodeSoonest(x->right)));
+    if (tree->combine != NULL) {
+        double own = tree->measure(x->pair->key, x->pair->value);
+        x->aggregate = tree->combine(tree->combine(nodeAggregate(tree, x->left), own),
+                                     nodeAggregate(tree, x->right));
+    }
+}
+
+
+void updatePath(TreeMap * tree, TreeNode* x) {
+    while (x != NULL) {
+        updateNode(tree, x);
+        x = x->parent;
+    }
+}
+
+
+void lruUnlink(TreeMap * tree, TreeNode* x) {
+    if (x->older == NULL && tree->oldest != x) return;
+
+    if (tree->hand == x) tree->hand = x->newer;
+    if (x->older != NULL) x->older->newer = x->newer;
+    else tree->oldest = x->newer;
+    if (x->newer != NULL) x->newer->older = x->older;
+    else tree->newest = x->older;
+    x->older = x->newer = NULL;
+}
+
+
+void lruPush(TreeMap * tree, TreeNode* x) {
+    x->older = tree->newest;
+    x->newer = NULL;
+    if (tree->newest != NULL) tree->newest->newer = x;
+    else tree->oldest = x;
+    tree->newest = x;
+}
+
+
+void lruTouch(TreeMap * tree, TreeNode* x) {
+    if (tree->newest == x) return;
+
+    lruUnlink(tree, x);
+    lruPush(tree, x);
+}
+
+
+int isExpired(TreeMap * tree, TreeNode* x) {
+    return x->expires != 0 && x->expires <= tree->now();
+}
+
+
+TreeNode* insertNode(TreeMap * tree, void* key, void * value){
+
+  TreeNode* parent=NULL;
   TreeNode* current=tree->root;
-  TreeNode* newNode=createTreeNode(key, value);
+  int left=0;
 
   while(current!=NULL){
-    if(is_equal(tree, key, current->pair->key)){
-      return;
-    }else if(tree->lower_than(key, current->pair->key)){
-      if (current->left==NULL){
-        current->left=newNode;
-        newNode->parent=current;
-        tree->current=newNode;
-        return;
-      }else{
-        current=current->left;
-      }
+    parent=current;
+    if(tree->lower_than(key, current->pair->key)){
+      left=1;
+      current=current->left;
+    }else if(!tree->multi && !tree->lower_than(current->pair->key, key)){
+      return NULL;
     }else{
-      if (current->right==NULL){
-        current->right=newNode;
-        newNode->parent=current;
-        tree->current=newNode;
-        return;
-      }else{
-        current=current->right;
-      }
+      left=0;
+      current=current->right;
     }
   }
+
+  TreeNode* newNode=createTreeNode(key, value);
+  if (newNode==NULL) return NULL;
+
+  newNode->parent=parent;
+  if (parent==NULL) tree->root=newNode;
+  else if (left) parent->left=newNode;
+  else parent->right=newNode;
+
+  updatePath(tree, newNode);
+  tree->current=newNode;
+  return newNode;
 }
 
 
@@ -90,11 +215,56 @@ TreeNode* minimum(TreeNode* x) {
 }
 
 
+TreeNode* maximum(TreeNode* x) {
+    if (x == NULL) return NULL;
+
+    while (x->right != NULL) {
+        x = x->right;
+    }
+
+    return x;
+}
+
+
+TreeNode* successor(TreeNode* x) {
+    if (x == NULL) return NULL;
+
+    if (x->right != NULL) return minimum(x->right);
+
+    TreeNode* parent = x->parent;
+    while (parent != NULL && x == parent->right) {
+        x = parent;
+        parent = parent->parent;
+    }
+    return parent;
+}
+
+
+TreeNode* firstEqual(TreeMap * tree, void* key) {
+    TreeNode* current = tree->root;
+    TreeNode* found = NULL;
+
+    while (current != NULL) {
+        if (tree->lower_than(current->pair->key, key)) {
+            current = current->right;
+        } else {
+            if (!tree->lower_than(key, current->pair->key)) found = current;
+            current = current->left;
+        }
+    }
+
+    return found;
+}
+
+
 void removeNode(TreeMap * tree, TreeNode* node) {
   if (tree == NULL || node == NULL || tree->root == NULL) return;
 
   TreeNode* parent = node->parent;
 
+  if (tree->current == node) tree->current = successor(node);
+  if (tree->cache) lruUnlink(tree, node);
+
   if (node->left == NULL && node->right == NULL) {
     if (parent != NULL) {
       if (parent->left == node) {
@@ -109,6 +279,8 @@ void removeNode(TreeMap * tree, TreeNode* node) {
         tree->root = NULL;
       }
     }
+    updatePath(tree, parent);
+    free(node->pair);
     free(node);
   }
 
@@ -129,15 +301,139 @@ void removeNode(TreeMap * tree, TreeNode* node) {
       }
       child->parent = NULL;
     }
+    updatePath(tree, parent);
+    free(node->pair);
     free(node);
     }
     
     else {
-      TreeNode* successor = minimum(node->right);
-      node->pair->key = successor->pair->key;
-      node->pair->value = successor->pair->value;
-      removeNode(tree, successor);
+      TreeNode* next = minimum(node->right);
+      TreeNode* from = next;
+      if (next->parent != node) {
+        from = next->parent;
+        from->left = next->right;
+        if (next->right != NULL) next->right->parent = from;
+        next->right = node->right;
+        next->right->parent = next;
+      }
+      next->left = node->left;
+      next->left->parent = next;
+      next->parent = parent;
+      if (parent == NULL) tree->root = next;
+      else if (parent->left == node) parent->left = next;
+      else parent->right = next;
+      updatePath(tree, from);
+      free(node->pair);
+      free(node);
+    }
+}
+
+
+void evictNode(TreeMap * tree, TreeNode* node) {
+    void* key = node->pair->key;
+    void* value = node->pair->value;
+
+    removeNode(tree, node);
+    if (tree->evict != NULL) tree->evict(key, value);
+}
+
+
+TreeNode* liveFrom(TreeMap * tree, TreeNode* x) {
+    while (x != NULL && tree->cache && isExpired(tree, x)) {
+        TreeNode* next = successor(x);
+        evictNode(tree, x);
+        x = next;
+    }
+    return x;
+}
+
+
+TreeNode* expiredIn(TreeMap * tree, TreeNode* x, void* lo, void* hi, long now) {
+    if (x == NULL || x->soonest == 0 || x->soonest > now) return NULL;
+
+    int above = !tree->lower_than(x->pair->key, lo);
+    int below = !tree->lower_than(hi, x->pair->key);
+
+    if (above) {
+        TreeNode* found = expiredIn(tree, x->left, lo, hi, now);
+        if (found != NULL) return found;
+    }
+    if (above && below && x->expires != 0 && x->expires <= now) return x;
+    if (below) return expiredIn(tree, x->right, lo, hi, now);
+    return NULL;
+}
+
+
+void expireRange(TreeMap * tree, void* lo, void* hi) {
+    if (!tree->cache) return;
+
+    long now = tree->now();
+    TreeNode* x;
+    while ((x = expiredIn(tree, tree->root, lo, hi, now)) != NULL) evictNode(tree, x);
+}
+
+
+void pruneTreeMap(TreeMap * tree) {
+    int steps = 4;
+
+    while (steps-- > 0 && tree->oldest != NULL) {
+        if (tree->hand == NULL) tree->hand = tree->oldest;
+
+        TreeNode* x = tree->hand;
+        tree->hand = x->newer;
+        if (isExpired(tree, x)) evictNode(tree, x);
+    }
+
+    while (tree->capacity > 0 && nodeSize(tree->root) > tree->capacity) {
+        evictNode(tree, tree->oldest);
+    }
+}
+
+
+long defaultClock(void) {
+    return (long)time(NULL);
+}
+
+
+void setCacheTreeMap(TreeMap * tree, int capacity, void (*evict)(void* key, void* value), long (*now)(void)) {
+    if (tree == NULL) return;
+
+    tree->capacity = (capacity > 0) ? capacity : 0;
+    tree->evict = evict;
+    tree->now = (now != NULL) ? now : defaultClock;
+
+    if (!tree->cache) {
+        tree->cache = 1;
+        for (TreeNode* x = minimum(tree->root); x != NULL; x = successor(x)) lruPush(tree, x);
     }
+
+    pruneTreeMap(tree);
+}
+
+
+void insertTreeMap(TreeMap * tree, void* key, void * value){
+  if (tree==NULL) return;
+
+  TreeNode* newNode=insertNode(tree, key, value);
+  if (!tree->cache) return;
+
+  if (newNode!=NULL) lruPush(tree, newNode);
+  pruneTreeMap(tree);
+}
+
+
+void insertTreeMapTTL(TreeMap * tree, void* key, void * value, long ttl){
+  if (tree==NULL) return;
+
+  TreeNode* newNode=insertNode(tree, key, value);
+  if (newNode==NULL || !tree->cache) return;
+
+  if (ttl > 0) {
+    newNode->expires = tree->now() + ttl;
+    updatePath(tree, newNode);
+  }
+  lruPush(tree, newNode);
+  pruneTreeMap(tree);
 }
 
 
@@ -145,42 +441,212 @@ void removeNode(TreeMap * tree, TreeNode* node) {
 void eraseTreeMap(TreeMap * tree, void* key){
     if (tree == NULL || tree->root == NULL) return;
 
-    if (searchTreeMap(tree, key) == NULL) return;
-    TreeNode* node = tree->current;
+    TreeNode* node = tree->root;
+    if (tree->multi) {
+        node = firstEqual(tree, key);
+    } else {
+        while (node != NULL && !is_equal(tree, key, node->pair->key)) {
+            if (tree->lower_than(key, node->pair->key)) node = node->left;
+            else node = node->right;
+        }
+    }
+    if (node == NULL) return;
     removeNode(tree, node);
+    if (tree->cache) pruneTreeMap(tree);
+}
+
+
+Pair * eraseAtIterator(TreeMap * tree) {
+    if (tree == NULL || tree->current == NULL || tree->root == NULL) return NULL;
+
+    removeNode(tree, tree->current);
+    if (tree->cache) {
+        pruneTreeMap(tree);
+        tree->current = liveFrom(tree, tree->current);
+    }
+
+    if (tree->current == NULL) return NULL;
+    return tree->current->pair;
+}
+
+
+int freeSubtree(TreeMap * tree, TreeNode* x, void (*release)(void* key, void* value)) {
+    int count = 0;
+
+    while (x != NULL) {
+        if (x->left != NULL) {
+            TreeNode* left = x->left;
+            x->left = left->right;
+            left->right = x;
+            x = left;
+        } else {
+            TreeNode* right = x->right;
+            if (tree->cache) lruUnlink(tree, x);
+            if (release != NULL) release(x->pair->key, x->pair->value);
+            free(x->pair);
+            free(x);
+            x = right;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+
+TreeNode* keepBelow(TreeMap * tree, TreeNode* x, void* lo, int* count, void (*release)(void* key, void* value)) {
+    TreeNode* root = NULL;
+    TreeNode* last = NULL;
+
+    while (x != NULL) {
+        if (tree->lower_than(x->pair->key, lo)) {
+            if (last == NULL) root = x;
+            else last->right = x;
+            x->parent = last;
+            last = x;
+            x = x->right;
+        } else {
+            TreeNode* left = x->left;
+            x->left = NULL;
+            *count += freeSubtree(tree, x, release);
+            x = left;
+        }
+    }
+
+    if (last != NULL) last->right = NULL;
+    updatePath(tree, last);
+    return root;
+}
+
+
+TreeNode* keepAbove(TreeMap * tree, TreeNode* x, void* hi, int* count, void (*release)(void* key, void* value)) {
+    TreeNode* root = NULL;
+    TreeNode* last = NULL;
+
+    while (x != NULL) {
+        if (tree->lower_than(hi, x->pair->key)) {
+            if (last == NULL) root = x;
+            else last->left = x;
+            x->parent = last;
+            last = x;
+            x = x->left;
+        } else {
+            TreeNode* right = x->right;
+            x->right = NULL;
+            *count += freeSubtree(tree, x, release);
+            x = right;
+        }
+    }
 
+    if (last != NULL) last->left = NULL;
+    updatePath(tree, last);
+    return root;
+}
+
+
+int eraseRangeTreeMap(TreeMap * tree, void* lo, void* hi, void (*release)(void* key, void* value)) {
+    if (tree == NULL || tree->root == NULL) return 0;
+    if (tree->lower_than(hi, lo)) return 0;
+
+    TreeNode* cursor = tree->current;
+    int inside = cursor != NULL && !tree->lower_than(cursor->pair->key, lo) &&
+                 !tree->lower_than(hi, cursor->pair->key);
+
+    TreeNode* parent = NULL;
+    TreeNode* above = NULL;
+    TreeNode* node = tree->root;
+
+    while (node != NULL) {
+        if (tree->lower_than(node->pair->key, lo)) {
+            parent = node;
+            node = node->right;
+        } else if (tree->lower_than(hi, node->pair->key)) {
+            parent = above = node;
+            node = node->left;
+        } else {
+            break;
+        }
+    }
+    if (node == NULL) return 0;
+
+    int count = 0;
+    TreeNode* left = keepBelow(tree, node->left, lo, &count, release);
+    TreeNode* right = keepAbove(tree, node->right, hi, &count, release);
+    node->left = node->right = NULL;
+    count += freeSubtree(tree, node, release);
+
+    TreeNode* next = (right != NULL) ? minimum(right) : above;
+    TreeNode* joined;
+    if (left == NULL) {
+        joined = right;
+    } else if (right == NULL) {
+        joined = left;
+    } else {
+        joined = next;
+        if (joined != right) {
+            joined->parent->left = joined->right;
+            if (joined->right != NULL) joined->right->parent = joined->parent;
+            updatePath(tree, joined->parent);
+            joined->right = right;
+            right->parent = joined;
+        }
+        joined->left = left;
+        left->parent = joined;
+    }
+
+    if (joined != NULL) joined->parent = parent;
+    if (parent == NULL) tree->root = joined;
+    else if (parent->left == node) parent->left = joined;
+    else parent->right = joined;
+    updatePath(tree, (joined != NULL) ? joined : parent);
+    if (inside) tree->current = next;
+    if (tree->cache) pruneTreeMap(tree);
+
+    return count;
 }
 
 
 Pair * searchTreeMap(TreeMap * tree, void* key){
+  if (tree!=NULL && tree->cache) pruneTreeMap(tree);
   if (tree==NULL || tree->root==NULL){
     return NULL;
   }
   TreeNode* current=tree->root;
-  while (current!=NULL){
-    if (is_equal(tree, key, current->pair->key)){
-      tree->current=current;
-      return tree->current->pair; 
-    } else if(tree->lower_than(key, current->pair->key)){
-      current=current->left;
-    } else{
-      current=current->right;
+  if (tree->multi) {
+    current=firstEqual(tree, key);
+  } else {
+    while (current!=NULL && !is_equal(tree, key, current->pair->key)){
+      if(tree->lower_than(key, current->pair->key)){
+        current=current->left;
+      } else{
+        current=current->right;
+      }
     }
   }
-  return NULL;
+  if (current==NULL) return NULL;
+
+  if (tree->cache) {
+    current=liveFrom(tree, current);
+    if (current==NULL || !is_equal(tree, key, current->pair->key)) return NULL;
+    lruTouch(tree, current);
+  }
+  tree->current=current;
+  return tree->current->pair; 
 }
 
 
 Pair* upperBound(TreeMap * tree, void* key) {
+  if (tree->cache) pruneTreeMap(tree);
   TreeNode* current = tree->root;
   TreeNode* ubNode = NULL;
 
   while (current != NULL) 
   {
-    if (is_equal(tree, current->pair->key, key)) 
+    if (!tree->multi && is_equal(tree, current->pair->key, key)) 
     {
-      return current->pair;
-    } else if (tree->lower_than(key, current->pair->key)) {
+      ubNode = current;
+      break;
+    } else if (!tree->lower_than(current->pair->key, key)) {
       ubNode = current;
       current = current->left;
     } else {
@@ -188,6 +654,7 @@ Pair* upperBound(TreeMap * tree, void* key) {
     }
   }
 
+  ubNode = liveFrom(tree, ubNode);
   if (ubNode == NULL) 
   {
     return NULL;
@@ -198,6 +665,156 @@ Pair* upperBound(TreeMap * tree, void* key) {
 }
 
 
+Pair * seekFrom(TreeMap * tree, void* key) {
+    if (tree == NULL || tree->root == NULL) return NULL;
+
+    TreeNode* x = (tree->current != NULL) ? tree->current : tree->root;
+    TreeNode* bound = NULL;
+
+    if (tree->lower_than(x->pair->key, key)) {
+        while (x->parent != NULL) {
+            TreeNode* parent = x->parent;
+            if (x == parent->left && !tree->lower_than(parent->pair->key, key)) {
+                bound = parent;
+                break;
+            }
+            x = parent;
+        }
+    } else {
+        while (x->parent != NULL) {
+            TreeNode* parent = x->parent;
+            if (x == parent->right && tree->lower_than(parent->pair->key, key)) break;
+            x = parent;
+        }
+    }
+
+    while (x != NULL) {
+        if (tree->lower_than(x->pair->key, key)) {
+            x = x->right;
+        } else {
+            bound = x;
+            x = x->left;
+        }
+    }
+
+    bound = liveFrom(tree, bound);
+    tree->current = bound;
+    if (bound == NULL) return NULL;
+    return bound->pair;
+}
+
+
+int countBelow(TreeMap * tree, void* key, int inclusive) {
+    TreeNode* current = tree->root;
+    int count = 0;
+
+    while (current != NULL) {
+        int below = inclusive ? !tree->lower_than(key, current->pair->key)
+                              : tree->lower_than(current->pair->key, key);
+        if (below) {
+            count += nodeSize(current->left) + 1;
+            current = current->right;
+        } else {
+            current = current->left;
+        }
+    }
+
+    return count;
+}
+
+
+int countKey(TreeMap * tree, void* key) {
+    if (tree == NULL) return 0;
+
+    expireRange(tree, key, key);
+    if (tree->root == NULL) return 0;
+
+    return countBelow(tree, key, 1) - countBelow(tree, key, 0);
+}
+
+
+void setAggregateTreeMap(TreeMap * tree, double (*measure)(void* key, void* value), double (*combine)(double a, double b), double identity) {
+    if (tree == NULL) return;
+
+    tree->measure = measure;
+    tree->combine = (measure != NULL) ? combine : NULL;
+    tree->identity = identity;
+    if (tree->combine == NULL) return;
+
+    TreeNode* x = tree->root;
+    TreeNode* prev = NULL;
+    while (x != NULL) {
+        if (prev == x->parent && x->left != NULL) {
+            prev = x;
+            x = x->left;
+        } else if (prev != x->right && x->right != NULL) {
+            prev = x;
+            x = x->right;
+        } else {
+            updateNode(tree, x);
+            prev = x;
+            x = x->parent;
+        }
+    }
+}
+
+
+double aggregateRange(TreeMap * tree, void* lo, void* hi) {
+    if (tree == NULL || tree->combine == NULL) return 0;
+
+    expireRange(tree, lo, hi);
+
+    TreeNode* split = tree->root;
+    while (split != NULL) {
+        if (tree->lower_than(split->pair->key, lo)) split = split->right;
+        else if (tree->lower_than(hi, split->pair->key)) split = split->left;
+        else break;
+    }
+    if (split == NULL || tree->lower_than(hi, lo)) return tree->identity;
+
+    double left = tree->identity;
+    for (TreeNode* x = split->left; x != NULL; ) {
+        if (tree->lower_than(x->pair->key, lo)) {
+            x = x->right;
+        } else {
+            double own = tree->measure(x->pair->key, x->pair->value);
+            left = tree->combine(tree->combine(own, nodeAggregate(tree, x->right)), left);
+            x = x->left;
+        }
+    }
+
+    double right = tree->identity;
+    for (TreeNode* x = split->right; x != NULL; ) {
+        if (tree->lower_than(hi, x->pair->key)) {
+            x = x->left;
+        } else {
+            double own = tree->measure(x->pair->key, x->pair->value);
+            right = tree->combine(right, tree->combine(nodeAggregate(tree, x->left), own));
+            x = x->right;
+        }
+    }
+
+    double own = tree->measure(split->pair->key, split->pair->value);
+    return tree->combine(tree->combine(left, own), right);
+}
+
+
+Pair * equalRange(TreeMap * tree, void* key, int* count) {
+    if (count != NULL) *count = 0;
+    if (tree == NULL) return NULL;
+
+    expireRange(tree, key, key);
+    if (tree->root == NULL) return NULL;
+
+    TreeNode* first = firstEqual(tree, key);
+    if (first == NULL) return NULL;
+
+    if (count != NULL) *count = countKey(tree, key);
+    tree->current = first;
+    return first->pair;
+}
+
+
 Pair * firstTreeMap(TreeMap * tree) {
     if (tree == NULL || tree->root == NULL) return NULL;
 
@@ -207,6 +824,9 @@ Pair * firstTreeMap(TreeMap * tree) {
         current = current->left;
     }
 
+    current = liveFrom(tree, current);
+    tree->current = current;
+    if (current == NULL) return NULL;
     return current->pair;
 }
 
@@ -214,6 +834,12 @@ Pair * firstTreeMap(TreeMap * tree) {
 Pair * nextTreeMap(TreeMap * tree) {
     if (tree == NULL || tree->current == NULL || tree->root == NULL) return NULL;
 
+    if (tree->cache) {
+        tree->current = liveFrom(tree, successor(tree->current));
+        if (tree->current == NULL) return NULL;
+        return tree->current->pair;
+    }
+
     TreeNode* current = tree->current;
 
     if (current->right != NULL) {
@@ -240,3 +866,647 @@ Pair * nextTreeMap(TreeMap * tree) {
     return NULL;
 }
 
+
+
+struct FrozenTreeMap {
+    Pair * data;
+    int size;
+    int current;
+    int (*lower_than) (void* key1, void* key2);
+};
+
+#ifdef __GNUC__
+#define prefetch(addr) __builtin_prefetch(addr)
+#else
+#define prefetch(addr) ((void)0)
+#endif
+
+
+int firstIndex(int size) {
+    if (size == 0) return 0;
+
+    int k = 1;
+    while (2 * k <= size) k = 2 * k;
+    return k;
+}
+
+
+int nextIndex(int k, int size) {
+    if (2 * k + 1 <= size) {
+        k = 2 * k + 1;
+        while (2 * k <= size) k = 2 * k;
+        return k;
+    }
+
+    while (k & 1) k >>= 1;
+    return k >> 1;
+}
+
+
+FrozenTreeMap * freezeTreeMap(TreeMap * tree) {
+    if (tree == NULL) return NULL;
+
+    FrozenTreeMap * frozen = (FrozenTreeMap *)malloc(sizeof(FrozenTreeMap));
+    if (frozen == NULL) return NULL;
+
+    frozen->size = nodeSize(tree->root);
+    frozen->current = 0;
+    frozen->lower_than = tree->lower_than;
+    frozen->data = (Pair *)malloc((frozen->size + 1) * sizeof(Pair));
+    if (frozen->data == NULL) {
+        free(frozen);
+        return NULL;
+    }
+
+    TreeNode* node = minimum(tree->root);
+    int k = firstIndex(frozen->size);
+    while (node != NULL && k != 0) {
+        frozen->data[k] = *node->pair;
+        node = successor(node);
+        k = nextIndex(k, frozen->size);
+    }
+
+    return frozen;
+}
+
+
+void freeFrozenTreeMap(FrozenTreeMap * frozen) {
+    if (frozen == NULL) return;
+
+    free(frozen->data);
+    free(frozen);
+}
+
+
+int lowerIndex(FrozenTreeMap * frozen, void* key) {
+    Pair * data = frozen->data;
+    int k = 1;
+
+    while (k <= frozen->size) {
+        prefetch(data + 4 * k);
+        k = 2 * k + (frozen->lower_than(data[k].key, key) != 0);
+    }
+
+    while (k & 1) k >>= 1;
+    return k >> 1;
+}
+
+
+Pair * searchFrozenTreeMap(FrozenTreeMap * frozen, void* key) {
+    if (frozen == NULL || frozen->size == 0) return NULL;
+
+    int k = lowerIndex(frozen, key);
+    if (k == 0 || frozen->lower_than(key, frozen->data[k].key)) return NULL;
+    return &frozen->data[k];
+}
+
+
+Pair * upperBoundFrozen(FrozenTreeMap * frozen, void* key) {
+    if (frozen == NULL || frozen->size == 0) return NULL;
+
+    int k = lowerIndex(frozen, key);
+    if (k == 0) return NULL;
+    return &frozen->data[k];
+}
+
+
+Pair * firstFrozenTreeMap(FrozenTreeMap * frozen) {
+    if (frozen == NULL || frozen->size == 0) return NULL;
+
+    frozen->current = firstIndex(frozen->size);
+    return &frozen->data[frozen->current];
+}
+
+
+Pair * nextFrozenTreeMap(FrozenTreeMap * frozen) {
+    if (frozen == NULL || frozen->current == 0) return NULL;
+
+    frozen->current = nextIndex(frozen->current, frozen->size);
+    if (frozen->current == 0) return NULL;
+    return &frozen->data[frozen->current];
+}
+
+
+Pair * nextFrozenAfter(FrozenTreeMap * frozen, Pair * pair) {
+    if (frozen == NULL || frozen->size == 0) return NULL;
+
+    int k = (pair == NULL) ? firstIndex(frozen->size)
+                           : nextIndex((int)(pair - frozen->data), frozen->size);
+    if (k == 0) return NULL;
+    return &frozen->data[k];
+}
+
+
+TreeNode* buildTree(TreeMap * tree, Pair** pairs, int lo, int hi, TreeNode* parent) {
+    if (lo > hi) return NULL;
+
+    int mid = lo + (hi - lo) / 2;
+    TreeNode* node = createTreeNode(pairs[mid]->key, pairs[mid]->value);
+    if (node == NULL) return NULL;
+
+    node->parent = parent;
+    node->left = buildTree(tree, pairs, lo, mid - 1, node);
+    node->right = buildTree(tree, pairs, mid + 1, hi, node);
+    updateNode(tree, node);
+    return node;
+}
+
+
+void sortPairs(TreeMap * tree, Pair * pairs, Pair * aux, int n) {
+    if (n < 2) return;
+
+    int half = n / 2;
+    sortPairs(tree, pairs, aux, half);
+    sortPairs(tree, pairs + half, aux, n - half);
+
+    int i = 0, j = half, k = 0;
+    while (i < half && j < n) {
+        if (tree->lower_than(pairs[j].key, pairs[i].key)) aux[k++] = pairs[j++];
+        else aux[k++] = pairs[i++];
+    }
+    while (i < half) aux[k++] = pairs[i++];
+    while (j < n) aux[k++] = pairs[j++];
+    memcpy(pairs, aux, n * sizeof(Pair));
+}
+
+
+int sortBatchTreeMap(TreeMap * tree, Pair * pairs, int n){
+  if (tree==NULL || pairs==NULL || n<=0) return 0;
+
+  Pair* aux=(Pair*)malloc(n * sizeof(Pair));
+  if (aux==NULL) return 0;
+  sortPairs(tree, pairs, aux, n);
+  free(aux);
+  return 1;
+}
+
+
+int insertSortedTreeMap(TreeMap * tree, Pair * pairs, int n){
+  if (tree==NULL || pairs==NULL || n<=0) return 0;
+
+  Pair** run=(Pair**)malloc(n * sizeof(Pair*));
+  if (run==NULL) return 0;
+
+  TreeNode* finger=NULL;
+  int i=0;
+  while (i<n){
+    void* key=pairs[i].key;
+    TreeNode* bound=NULL;
+    TreeNode* current=finger;
+    while (current!=NULL && current->parent!=NULL){
+      if (current==current->parent->left && tree->lower_than(key, current->parent->pair->key)){
+        bound=current->parent;
+        break;
+      }
+      current=current->parent;
+    }
+    if (current==NULL) current=tree->root;
+
+    TreeNode* parent=NULL;
+    int left=0, found=0;
+    while (current!=NULL){
+      parent=current;
+      if (tree->lower_than(key, current->pair->key)){
+        bound=current;
+        left=1;
+        current=current->left;
+      }else if (!tree->multi && !tree->lower_than(current->pair->key, key)){
+        found=1;
+        break;
+      }else{
+        left=0;
+        current=current->right;
+      }
+    }
+    if (found){
+      i++;
+      continue;
+    }
+
+    int m=0;
+    run[m++]=&pairs[i++];
+    while (i<n && (bound==NULL || tree->lower_than(pairs[i].key, bound->pair->key))){
+      if (tree->multi || tree->lower_than(run[m-1]->key, pairs[i].key)) run[m++]=&pairs[i];
+      i++;
+    }
+
+    TreeNode* sub=buildTree(tree, run, 0, m-1, parent);
+    if (sub==NULL) break;
+    if (parent==NULL) tree->root=sub;
+    else if (left) parent->left=sub;
+    else parent->right=sub;
+    updatePath(tree, parent);
+
+    if (tree->cache){
+      for (TreeNode* x=minimum(sub); m>0; x=successor(x), m--) lruPush(tree, x);
+    }
+    finger=maximum(sub);
+    tree->current=finger;
+  }
+
+  free(run);
+  if (tree->cache) pruneTreeMap(tree);
+  return 1;
+}
+
+
+void insertBatchTreeMap(TreeMap * tree, Pair * pairs, int n){
+  if (sortBatchTreeMap(tree, pairs, n)) insertSortedTreeMap(tree, pairs, n);
+}
+
+
+TreeMap* mergeTreeMap(TreeMap * a, TreeMap * b, int keepA, int keepB, int keepBoth) {
+    if (a == NULL || b == NULL) return NULL;
+
+    TreeMap* result = createTreeMap(a->lower_than);
+    if (result == NULL) return NULL;
+    result->multi = a->multi;
+    result->measure = a->measure;
+    result->combine = a->combine;
+    result->identity = a->identity;
+
+    Pair** pairs = (Pair**)malloc((nodeSize(a->root) + nodeSize(b->root) + 1) * sizeof(Pair*));
+    if (pairs == NULL) {
+        free(result);
+        return NULL;
+    }
+
+    int n = 0;
+    TreeNode* x = minimum(a->root);
+    TreeNode* y = minimum(b->root);
+
+    while (x != NULL || y != NULL) {
+        Pair* pair = NULL;
+        if (y == NULL || (x != NULL && a->lower_than(x->pair->key, y->pair->key))) {
+            if (keepA) pair = x->pair;
+            x = successor(x);
+        } else if (x == NULL || a->lower_than(y->pair->key, x->pair->key)) {
+            if (keepB) pair = y->pair;
+            y = successor(y);
+        } else {
+            if (keepBoth) pair = x->pair;
+            x = successor(x);
+            y = successor(y);
+        }
+
+        if (pair == NULL) continue;
+        if (!result->multi && n > 0 && !a->lower_than(pairs[n - 1]->key, pair->key)) continue;
+        pairs[n++] = pair;
+    }
+
+    result->root = buildTree(result, pairs, 0, n - 1, NULL);
+    free(pairs);
+    return result;
+}
+
+
+void destroyTreeMap(TreeMap * tree) {
+    if (tree == NULL) return;
+
+    tree->cache = 0;
+    freeSubtree(tree, tree->root, NULL);
+    free(tree);
+}
+
+
+TreeMap* unionTreeMap(TreeMap * a, TreeMap * b) {
+    return mergeTreeMap(a, b, 1, 1, 1);
+}
+
+
+TreeMap* intersectTreeMap(TreeMap * a, TreeMap * b) {
+    return mergeTreeMap(a, b, 0, 0, 1);
+}
+
+
+TreeMap* differenceTreeMap(TreeMap * a, TreeMap * b) {
+    return mergeTreeMap(a, b, 1, 0, 0);
+}
+
+
+int joinTreeMap(TreeMap * a, TreeMap * b, void (*callback)(void* key, void* valueA, void* valueB, void* data), void* data) {
+    if (a == NULL || b == NULL || callback == NULL) return 0;
+
+    int count = 0;
+    TreeNode* x = minimum(a->root);
+    TreeNode* y = minimum(b->root);
+
+    while (x != NULL && y != NULL) {
+        if (a->lower_than(x->pair->key, y->pair->key)) {
+            x = successor(x);
+        } else if (a->lower_than(y->pair->key, x->pair->key)) {
+            y = successor(y);
+        } else {
+            TreeNode* run = y;
+            void* key = x->pair->key;
+            while (x != NULL && !a->lower_than(key, x->pair->key)) {
+                for (y = run; y != NULL && !a->lower_than(key, y->pair->key); y = successor(y)) {
+                    callback(x->pair->key, x->pair->value, y->pair->value, data);
+                    count++;
+                }
+                x = successor(x);
+            }
+        }
+    }
+
+    return count;
+}
+
+
+struct TreeMapLog {
+    TreeMap * tree;
+    TreeMapCodec codec;
+    FILE * file;
+    char * path;
+    char * checkpoint;
+    char * temp;
+    char * dir;
+    int group;
+    int pending;
+    long generation;
+};
+
+
+char * suffixPath(const char * path, const char * suffix) {
+    char * aux = (char *)malloc(strlen(path) + strlen(suffix) + 1);
+    if (aux == NULL) return NULL;
+    strcpy(aux, path);
+    strcat(aux, suffix);
+    return aux;
+}
+
+
+char * parentPath(const char * path) {
+    const char * slash = strrchr(path, '/');
+    if (slash == NULL) return suffixPath(".", "");
+
+    int length = (slash == path) ? 1 : (int)(slash - path);
+    char * aux = (char *)malloc(length + 1);
+    if (aux == NULL) return NULL;
+    memcpy(aux, path, length);
+    aux[length] = '\0';
+    return aux;
+}
+
+
+int syncFile(FILE * file) {
+    if (fflush(file) != 0) return 0;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+
+int syncDirectory(const char * dir) {
+#ifdef _WIN32
+    (void)dir;
+    return 1;
+#else
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+
+void updateTreeMap(TreeMap * tree, void* key, void * value) {
+    Pair * pair = tree->multi ? NULL : searchTreeMap(tree, key);
+    if (pair != NULL) {
+        pair->value = value;
+        updatePath(tree, tree->current);
+    } else {
+        insertTreeMap(tree, key, value);
+    }
+}
+
+
+void releaseKey(TreeMapLog * log, void* key) {
+    if (log->codec.free_key != NULL) log->codec.free_key(key);
+}
+
+
+void releaseValue(TreeMapLog * log, void* value) {
+    if (log->codec.free_value != NULL) log->codec.free_value(value);
+}
+
+
+void applyTreeMapLog(TreeMapLog * log, int op, void* key, void * value) {
+    TreeMap * tree = log->tree;
+
+    if (op == 'E') {
+        if (searchTreeMap(tree, key) == NULL) return;
+        void * old_key = tree->current->pair->key;
+        void * old_value = tree->current->pair->value;
+        removeNode(tree, tree->current);
+        releaseKey(log, old_key);
+        releaseValue(log, old_value);
+        return;
+    }
+
+    Pair * pair = tree->multi ? NULL : searchTreeMap(tree, key);
+    if (pair == NULL) {
+        insertTreeMap(tree, key, value);
+        return;
+    }
+
+    releaseKey(log, key);
+    if (op == 'I') {
+        releaseValue(log, value);
+    } else {
+        releaseValue(log, pair->value);
+        pair->value = value;
+        updatePath(tree, tree->current);
+    }
+}
+
+
+int writeGeneration(FILE * file, long generation) {
+    return fwrite(&generation, sizeof(long), 1, file) == 1;
+}
+
+
+long replayTreeMapLog(TreeMapLog * log, const char * path, long generation) {
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) return -1;
+
+    long found;
+    if (fread(&found, sizeof(long), 1, file) != 1) {
+        fclose(file);
+        return -1;
+    }
+    if (generation >= 0 && found != generation) {
+        fclose(file);
+        return found;
+    }
+
+    int op;
+    while ((op = fgetc(file)) != EOF) {
+        void * key = log->codec.read_key(file);
+        if (ferror(file) || feof(file)) {
+            releaseKey(log, key);
+            break;
+        }
+
+        if (op == 'E') {
+            applyTreeMapLog(log, op, key, NULL);
+            releaseKey(log, key);
+            continue;
+        }
+
+        void * value = log->codec.read_value(file);
+        if (ferror(file) || feof(file) || (op != 'I' && op != 'U')) {
+            releaseKey(log, key);
+            releaseValue(log, value);
+            break;
+        }
+        applyTreeMapLog(log, op, key, value);
+    }
+
+    fclose(file);
+    return found;
+}
+
+
+int checkpointTreeMap(TreeMapLog * log) {
+    if (log == NULL) return 0;
+
+    FILE * file = fopen(log->temp, "wb");
+    if (file == NULL) return 0;
+
+    writeGeneration(file, log->generation + 1);
+    TreeNode * node = minimum(log->tree->root);
+    while (node != NULL) {
+        fputc('I', file);
+        log->codec.write_key(file, node->pair->key);
+        log->codec.write_value(file, node->pair->value);
+        node = successor(node);
+    }
+
+    if (ferror(file) || !syncFile(file)) {
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+#ifdef _WIN32
+    remove(log->checkpoint);
+#endif
+    if (rename(log->temp, log->checkpoint) != 0) return 0;
+    log->generation++;
+    if (!syncDirectory(log->dir)) return 0;
+
+    if (log->file != NULL) fclose(log->file);
+    log->pending = 0;
+    log->file = fopen(log->path, "wb");
+    if (log->file == NULL) return 0;
+    return writeGeneration(log->file, log->generation) && syncFile(log->file);
+}
+
+
+TreeMapLog * openTreeMapLog(TreeMap * tree, const char * path, TreeMapCodec codec, int group) {
+    if (tree == NULL || tree->root != NULL || path == NULL) return NULL;
+    if (codec.write_key == NULL || codec.write_value == NULL) return NULL;
+    if (codec.read_key == NULL || codec.read_value == NULL) return NULL;
+
+    TreeMapLog * log = (TreeMapLog *)malloc(sizeof(TreeMapLog));
+    if (log == NULL) return NULL;
+
+    log->tree = tree;
+    log->codec = codec;
+    log->file = NULL;
+    log->group = (group > 0) ? group : 1;
+    log->pending = 0;
+    log->path = suffixPath(path, "");
+    log->checkpoint = suffixPath(path, ".ckpt");
+    log->temp = suffixPath(path, ".tmp");
+    log->dir = parentPath(path);
+
+    if (log->path == NULL || log->checkpoint == NULL || log->temp == NULL || log->dir == NULL) {
+        closeTreeMapLog(log);
+        return NULL;
+    }
+
+    log->generation = replayTreeMapLog(log, log->checkpoint, -1);
+    if (log->generation < 0) log->generation = 0;
+    replayTreeMapLog(log, log->path, log->generation);
+
+    if (!checkpointTreeMap(log)) {
+        while (tree->root != NULL) {
+            void * key = tree->root->pair->key;
+            void * value = tree->root->pair->value;
+            removeNode(tree, tree->root);
+            releaseKey(log, key);
+            releaseValue(log, value);
+        }
+        closeTreeMapLog(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+
+int syncTreeMapLog(TreeMapLog * log) {
+    if (log == NULL || log->file == NULL) return 0;
+    if (log->pending == 0) return 1;
+
+    if (!syncFile(log->file)) return 0;
+    log->pending = 0;
+    return 1;
+}
+
+
+int appendTreeMapLog(TreeMapLog * log, int op, void* key, void * value) {
+    if (log->file == NULL || ferror(log->file)) return 0;
+
+    fputc(op, log->file);
+    log->codec.write_key(log->file, key);
+    if (op != 'E') log->codec.write_value(log->file, value);
+    if (ferror(log->file)) return 0;
+
+    if (++log->pending >= log->group && !syncTreeMapLog(log)) return -1;
+    return 1;
+}
+
+
+int logTreeMap(TreeMapLog * log, int op, void* key, void * value) {
+    if (log == NULL) return 0;
+
+    int status = appendTreeMapLog(log, op, key, value);
+    if (status != 0) applyTreeMapLog(log, op, key, value);
+    return status;
+}
+
+
+int logInsertTreeMap(TreeMapLog * log, void* key, void * value) {
+    return logTreeMap(log, 'I', key, value);
+}
+
+
+int logEraseTreeMap(TreeMapLog * log, void* key) {
+    return logTreeMap(log, 'E', key, NULL);
+}
+
+
+int logUpdateTreeMap(TreeMapLog * log, void* key, void * value) {
+    return logTreeMap(log, 'U', key, value);
+}
+
+
+void closeTreeMapLog(TreeMapLog * log) {
+    if (log == NULL) return;
+
+    if (log->file != NULL) {
+        syncTreeMapLog(log);
+        fclose(log->file);
+    }
+    free(log->path);
+    free(log->checkpoint);
+    free(log->temp);
+    free(log->dir);
+    free(log);
+}
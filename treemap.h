@@ -1,25 +1,124 @@
 #ifndef TREEMAP_h
 #define TREEMAP_h
 
+#include <stdio.h>
+
 typedef struct TreeMap TreeMap;
 
+typedef struct FrozenTreeMap FrozenTreeMap;
+
 typedef struct Pair {
      void * key;
      void * value;
 } Pair;
 
+typedef struct TreeMapLog TreeMapLog;
+
+typedef struct TreeMapCodec {
+     void (*write_key) (FILE* file, void* key);
+     void (*write_value) (FILE* file, void* value);
+     void * (*read_key) (FILE* file);
+     void * (*read_value) (FILE* file);
+     void (*free_key) (void* key);
+     void (*free_value) (void* value);
+} TreeMapCodec;
+
 TreeMap * createTreeMap(int (*lower_than_int) (void* key1, void* key2));
 
+TreeMap * createMultiTreeMap(int (*lower_than_int) (void* key1, void* key2));
+
+void destroyTreeMap(TreeMap * tree);
+
 void insertTreeMap(TreeMap * tree, void* key, void * value);
 
+void insertBatchTreeMap(TreeMap * tree, Pair * pairs, int n);
+
+int sortBatchTreeMap(TreeMap * tree, Pair * pairs, int n);
+
+int insertSortedTreeMap(TreeMap * tree, Pair * pairs, int n);
+
+void insertTreeMapTTL(TreeMap * tree, void* key, void * value, long ttl);
+
+void setCacheTreeMap(TreeMap * tree, int capacity, void (*evict)(void* key, void* value), long (*now)(void));
+
 void eraseTreeMap(TreeMap * tree, void* key);
 
+Pair * eraseAtIterator(TreeMap * tree);
+
+int eraseRangeTreeMap(TreeMap * tree, void* lo, void* hi, void (*release)(void* key, void* value));
+
 Pair * searchTreeMap(TreeMap * tree, void* key);
 
 Pair * upperBound(TreeMap * tree, void* key);
 
+Pair * seekFrom(TreeMap * tree, void* key);
+
+int countKey(TreeMap * tree, void* key);
+
+void setAggregateTreeMap(TreeMap * tree, double (*measure)(void* key, void* value), double (*combine)(double a, double b), double identity);
+
+double aggregateRange(TreeMap * tree, void* lo, void* hi);
+
+Pair * equalRange(TreeMap * tree, void* key, int* count);
+
 Pair * firstTreeMap(TreeMap * tree);
 
 Pair * nextTreeMap(TreeMap * tree);
 
+TreeMap * unionTreeMap(TreeMap * a, TreeMap * b);
+
+TreeMap * intersectTreeMap(TreeMap * a, TreeMap * b);
+
+TreeMap * differenceTreeMap(TreeMap * a, TreeMap * b);
+
+int joinTreeMap(TreeMap * a, TreeMap * b, void (*callback)(void* key, void* valueA, void* valueB, void* data), void* data);
+
+FrozenTreeMap * freezeTreeMap(TreeMap * tree);
+
+void freeFrozenTreeMap(FrozenTreeMap * frozen);
+
+/*
+ * searchFrozenTreeMap, upperBoundFrozen y nextFrozenAfter no escriben en
+ * el mapa congelado, asi que varios hilos pueden compartirlo:
+ *
+ *   for (Pair* p = upperBoundFrozen(frozen, lo); p != NULL; p = nextFrozenAfter(frozen, p))
+ *
+ * nextFrozenAfter(frozen, NULL) retorna el primer dato. firstFrozenTreeMap
+ * y nextFrozenTreeMap usan el cursor del mapa y son para un solo hilo.
+ */
+Pair * searchFrozenTreeMap(FrozenTreeMap * frozen, void* key);
+
+Pair * upperBoundFrozen(FrozenTreeMap * frozen, void* key);
+
+Pair * firstFrozenTreeMap(FrozenTreeMap * frozen);
+
+Pair * nextFrozenTreeMap(FrozenTreeMap * frozen);
+
+Pair * nextFrozenAfter(FrozenTreeMap * frozen, Pair * pair);
+
+void updateTreeMap(TreeMap * tree, void* key, void * value);
+
+/*
+ * El log se queda con lo que recibe: logInsertTreeMap y logUpdateTreeMap
+ * entregan key y value al mapa, y los datos que salen del mapa por el log
+ * (borrados, valores reemplazados, inserts repetidos) se liberan con
+ * free_key/free_value, igual que al recuperar. La clave de
+ * logEraseTreeMap solo se usa para buscar. openTreeMapLog necesita un mapa
+ * vacio. Las funciones log* retornan 1 si el cambio se aplico, 0 si no se
+ * pudo escribir (el mapa no cambia) y -1 si se aplico pero fallo el fsync.
+ */
+TreeMapLog * openTreeMapLog(TreeMap * tree, const char * path, TreeMapCodec codec, int group);
+
+int logInsertTreeMap(TreeMapLog * log, void* key, void * value);
+
+int logEraseTreeMap(TreeMapLog * log, void* key);
+
+int logUpdateTreeMap(TreeMapLog * log, void* key, void * value);
+
+int syncTreeMapLog(TreeMapLog * log);
+
+int checkpointTreeMap(TreeMapLog * log);
+
+void closeTreeMapLog(TreeMapLog * log);
+
 #endif /* TREEMAP_h */
@@ -0,0 +1,188 @@
+#ifndef TREEMAP_GEN_h
+#define TREEMAP_GEN_h
+
+#include <stdlib.h>
+
+/*
+ * DEFINE_TREEMAP(Name, KeyT, ValT, lower_than) genera un mapa ordenado
+ * especializado para KeyT/ValT. Las claves y valores se guardan por valor
+ * dentro del nodo (una sola reserva de memoria por dato) y lower_than(a, b)
+ * recibe dos KeyT y se expande en linea, sin punteros a funcion.
+ *
+ *   #define lower_than_int(a, b) ((a) < (b))
+ *   DEFINE_TREEMAP(IntMap, int, char*, lower_than_int)
+ *
+ * genera el tipo IntMap, IntMapNode y las funciones createIntMap,
+ * insertIntMap, searchIntMap, eraseIntMap, upperBoundIntMap, firstIntMap,
+ * nextIntMap y destroyIntMap, con el mismo comportamiento que las de
+ * treemap.h (claves repetidas no se insertan, current es el cursor).
+ */
+#define DEFINE_TREEMAP(Name, KeyT, ValT, lower_than)                          \
+                                                                              \
+typedef struct Name##Node Name##Node;                                         \
+                                                                              \
+struct Name##Node {                                                           \
+    KeyT key;                                                                 \
+    ValT value;                                                               \
+    Name##Node * left;                                                        \
+    Name##Node * right;                                                       \
+    Name##Node * parent;                                                      \
+};                                                                            \
+                                                                              \
+typedef struct Name {                                                         \
+    Name##Node * root;                                                        \
+    Name##Node * current;                                                     \
+    int size;                                                                 \
+} Name;                                                                       \
+                                                                              \
+static inline Name * create##Name(void) {                                     \
+    Name * map = (Name *)malloc(sizeof(Name));                                \
+    if (map == NULL) return NULL;                                             \
+    map->root = map->current = NULL;                                          \
+    map->size = 0;                                                            \
+    return map;                                                               \
+}                                                                             \
+                                                                              \
+static inline Name##Node * minimum##Name(Name##Node * x) {                    \
+    if (x == NULL) return NULL;                                               \
+    while (x->left != NULL) x = x->left;                                      \
+    return x;                                                                 \
+}                                                                             \
+                                                                              \
+static inline Name##Node * successor##Name(Name##Node * x) {                  \
+    if (x->right != NULL) return minimum##Name(x->right);                     \
+    Name##Node * parent = x->parent;                                          \
+    while (parent != NULL && x == parent->right) {                            \
+        x = parent;                                                           \
+        parent = parent->parent;                                              \
+    }                                                                         \
+    return parent;                                                            \
+}                                                                             \
+                                                                              \
+static inline void insert##Name(Name * map, KeyT key, ValT value) {           \
+    Name##Node * parent = NULL;                                               \
+    Name##Node * current = map->root;                                         \
+    int left = 0;                                                             \
+                                                                              \
+    while (current != NULL) {                                                 \
+        parent = current;                                                     \
+        if (lower_than(key, current->key)) {                                  \
+            left = 1;                                                         \
+            current = current->left;                                          \
+        } else if (!lower_than(current->key, key)) {                          \
+            return;                                                           \
+        } else {                                                              \
+            left = 0;                                                         \
+            current = current->right;                                         \
+        }                                                                     \
+    }                                                                         \
+                                                                              \
+    Name##Node * node = (Name##Node *)malloc(sizeof(Name##Node));             \
+    if (node == NULL) return;                                                 \
+    node->key = key;                                                          \
+    node->value = value;                                                      \
+    node->left = node->right = NULL;                                          \
+    node->parent = parent;                                                    \
+                                                                              \
+    if (parent == NULL) map->root = node;                                     \
+    else if (left) parent->left = node;                                       \
+    else parent->right = node;                                                \
+    map->current = node;                                                      \
+    map->size++;                                                              \
+}                                                                             \
+                                                                              \
+static inline Name##Node * search##Name(Name * map, KeyT key) {               \
+    Name##Node * current = map->root;                                         \
+    while (current != NULL) {                                                 \
+        if (lower_than(key, current->key)) current = current->left;           \
+        else if (lower_than(current->key, key)) current = current->right;     \
+        else {                                                                \
+            map->current = current;                                           \
+            return current;                                                   \
+        }                                                                     \
+    }                                                                         \
+    return NULL;                                                              \
+}                                                                             \
+                                                                              \
+static inline Name##Node * upperBound##Name(Name * map, KeyT key) {           \
+    Name##Node * current = map->root;                                         \
+    Name##Node * bound = NULL;                                                \
+    while (current != NULL) {                                                 \
+        if (lower_than(current->key, key)) {                                  \
+            current = current->right;                                         \
+        } else {                                                              \
+            bound = current;                                                  \
+            current = current->left;                                          \
+        }                                                                     \
+    }                                                                         \
+    return bound;                                                             \
+}                                                                             \
+                                                                              \
+static inline void replace##Name(Name * map, Name##Node * node,               \
+                                 Name##Node * child) {                        \
+    if (node->parent == NULL) map->root = child;                              \
+    else if (node->parent->left == node) node->parent->left = child;          \
+    else node->parent->right = child;                                         \
+    if (child != NULL) child->parent = node->parent;                          \
+}                                                                             \
+                                                                              \
+static inline void erase##Name(Name * map, KeyT key) {                        \
+    Name##Node * node = map->root;                                            \
+    while (node != NULL) {                                                    \
+        if (lower_than(key, node->key)) node = node->left;                    \
+        else if (lower_than(node->key, key)) node = node->right;              \
+        else break;                                                           \
+    }                                                                         \
+    if (node == NULL) return;                                                 \
+                                                                              \
+    if (map->current == node) map->current = successor##Name(node);          \
+                                                                              \
+    if (node->left == NULL) {                                                 \
+        replace##Name(map, node, node->right);                                \
+    } else if (node->right == NULL) {                                         \
+        replace##Name(map, node, node->left);                                 \
+    } else {                                                                  \
+        Name##Node * next = minimum##Name(node->right);                       \
+        if (next->parent != node) {                                           \
+            replace##Name(map, next, next->right);                            \
+            next->right = node->right;                                        \
+            next->right->parent = next;                                       \
+        }                                                                     \
+        replace##Name(map, node, next);                                       \
+        next->left = node->left;                                              \
+        next->left->parent = next;                                            \
+    }                                                                         \
+    free(node);                                                               \
+    map->size--;                                                              \
+}                                                                             \
+                                                                              \
+static inline Name##Node * first##Name(Name * map) {                          \
+    map->current = minimum##Name(map->root);                                  \
+    return map->current;                                                      \
+}                                                                             \
+                                                                              \
+static inline Name##Node * next##Name(Name * map) {                           \
+    if (map->current == NULL) return NULL;                                    \
+    map->current = successor##Name(map->current);                             \
+    return map->current;                                                      \
+}                                                                             \
+                                                                              \
+static inline void destroy##Name(Name * map) {                                \
+    if (map == NULL) return;                                                  \
+    Name##Node * x = map->root;                                               \
+    while (x != NULL) {                                                       \
+        if (x->left != NULL) {                                                \
+            Name##Node * left = x->left;                                      \
+            x->left = left->right;                                            \
+            left->right = x;                                                  \
+            x = left;                                                         \
+        } else {                                                              \
+            Name##Node * right = x->right;                                    \
+            free(x);                                                          \
+            x = right;                                                        \
+        }                                                                     \
+    }                                                                         \
+    free(map);                                                                \
+}
+
+#endif /* TREEMAP_GEN_h */